@@ -25,18 +25,29 @@
 #define UNFOCUS         "#121212" /* unfocused window border color */
 #define SCRATCH         "#cc0000" /* scratchpad border color */
 #define DESKTOPS        10        /* number of desktops - edit DESKTOPCHANGE keys to suit */
+#define RECLAIM_DESKTOPS False    /* free empty desktops when leaving them, they forget their settings */
+#define UNMAP_HIDDEN    False     /* unmap hidden windows so they stop drawing, else move them offscreen */
+#define SUSPEND_DESKTOPS 0        /* bitmask of desktops whose processes are stopped while hidden, see rules */
+#define SUSPEND_DELAY   10        /* seconds a window is hidden before its process is stopped */
 #define DEFAULT_DESKTOP 0         /* the desktop to focus on exec */
 #define MINWSZ          50        /* minimum window size in pixels */
 #define USELESSGAP      8         /* the size of the useless gap in pixels */
 #define GLOBALGAPS      True      /* use the same gap size on all desktops */
 #define MONOCLE_BORDERS False     /* display borders in monocle mode */
+#define SIZE_HINTS      True      /* tiled windows keep to the size increments and limits they ask for */
+#define HINTS_CENTER    False     /* center windows shrunk by their size hints, else keep the space right and below */
 #define INVERT          False     /* use alternative modes by default */
 #define AUTOCENTER      True      /* automatically center windows floating by default */
 #define OUTPUT          False     /* write desktop info to stdout */
 #define OUTPUT_TITLE    False     /* output the title of the currently active window */
+#define SHM_STATE       False     /* publish desktop info in shared memory, see frankenwm(1) */
+#define SHM_NAME        "/frankenwm" /* name of the shared memory object */
+#define IPC             False     /* accept commands and queries on a unix socket */
+#define IPC_SOCKET      "frankenwm.sock" /* relative to $XDG_RUNTIME_DIR (or /tmp), the display is appended */
 #define USE_SCRATCHPAD  False     /* enable the scratchpad functionality */
 #define CLOSE_SCRATCHPAD True     /* close scratchpad on quit */
-#define SCRPDNAME       "scratchpad" /* the instance of the scratchpad window */
+#define SCRPDRESPAWN    5         /* seconds a closed scratchpad must have run to be restarted at once */
+#define SCRPDNAME       "scratchpad" /* the instance of the first scratchpad window */
 #define EWMH_TASKBAR    True      /* False if text (or no) panel/taskbar */
 
 /*
@@ -44,6 +55,8 @@
  * Open applications to specified desktop with specified mode.
  * If desktop is negative, then current is assumed. Desktops are 0-indexed.
  * If border_width is negative, the default is assumed.
+ * If monitor is negative, the one under the pointer is assumed.
+ * If suspend is set, the process is stopped while its windows are hidden.
  *
  * The matching is done via POSIX-ERE-regexes on the class or instance strings
  * as reported by xprop(1):
@@ -58,9 +71,9 @@
  * you do not wish to use this functionality.
  */
 static const AppRule rules[] = { \
-    /* class     instance  desktop  follow  float  border_with */
-    { "^GIMP$",  ".*",     -1,      False,  True,  0 },
-    { "Skype",   ".*",      3,      False,  True,  -1 },
+    /* class     instance  desktop  follow  float  border_with  monitor  suspend */
+    { "^GIMP$",  ".*",     -1,      False,  True,  0,            -1,      False },
+    { "Skype",   ".*",      3,      False,  True,  -1,           -1,      False },
 };
 
 /* helper for spawning shell commands, usually you don't edit this */
@@ -79,6 +92,19 @@ static const char *termcmd[] = { "xterm",     NULL };
 static const char *menucmd[] = { "dmenu_run", NULL };
 static const char *scrpcmd[] = { "xterm", "-T", "scratchpad", NULL };
 /* static const char *scrpcmd[] = { "urxvt", "-name", "scratchpad",  NULL }; */
+/* static const char *calccmd[] = { "xterm", "-name", "calc", "-e", "bc", NULL }; */
+
+/*
+ * EDIT THIS: scratchpads
+ * togglescratchpad {.i = n} shows and hides the nth one. They are started
+ * with FrankenWM and wait hidden, one that is closed is started again right
+ * away. A window whose instance matches name becomes the scratchpad.
+ */
+static const Scratchpad scratchpads[] = {
+    /* instance     command */
+    {  SCRPDNAME,   scrpcmd },
+/*  {  "calc",      calccmd }, */
+};
 
 #define DESKTOPCHANGE(K,N) \
     {  MOD4,             K,              change_desktop, {.i = N}}, \
@@ -118,7 +144,7 @@ static key keys[] = {
     /* show/hide all windows on all desktops */
     {  MOD4|CONTROL,     XK_s,          showhide,          {NULL}},
     /* toggle the scratchpad terminal, if enabled */
-    {  MOD4,             XK_s,          togglescratchpad,  {NULL}},
+    {  MOD4,             XK_s,          togglescratchpad,  {.i = 0}},
 
     /* move floating windows */
     {  MOD4|MOD1,        XK_j,          float_y,           {.i = +10}},
@@ -144,6 +170,10 @@ static key keys[] = {
     {  MOD4|SHIFT,       XK_z,          rotate_mode,       {.i = -1}},
     {  MOD4|SHIFT,       XK_x,          rotate_mode,       {.i = +1}},
 
+    /* focus the next/previous monitor */
+    {  MOD4,             XK_period,     rotate_monitor,    {.i = +1}},
+    {  MOD4,             XK_comma,      rotate_monitor,    {.i = -1}},
+
     /* spawn terminal, dmenu, w/e you want to */
     {  MOD4|SHIFT,       XK_Return,     spawn,             {.com = termcmd}},
     {  MOD4,             XK_r,          spawn,             {.com = menucmd}},
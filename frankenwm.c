@@ -1,15 +1,29 @@
 /* see license for copyright and license */
 
 #include <stdlib.h>
+#include <stddef.h>
 #include <stdio.h>
 #include <err.h>
 #include <stdarg.h>
 #include <stdbool.h>
+#include <time.h>
 #include <unistd.h>
 #include <string.h>
 #include <signal.h>
+#include <spawn.h>
 #include <regex.h>
 #include <sys/wait.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#ifdef __linux__
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#endif /* __linux__ */
 #include <X11/Xlib.h>
 #include <X11/keysym.h>
 #include <xcb/xcb.h>
@@ -18,6 +32,10 @@
 #include <xcb/xcb_icccm.h>
 #include <xcb/xcb_keysyms.h>
 #include <xcb/xcb_ewmh.h>
+#include <xcb/randr.h>
+#include <xcb/xinerama.h>
+
+#include "layout.h"
 
 /* compile with -DDEBUGGING for debugging output */
 #ifdef DEBUGGING
@@ -41,10 +59,8 @@ enum { _NET_WM_STATE_REMOVE, _NET_WM_STATE_ADD, _NET_WM_STATE_TOGGLE };
 #define LENGTH(x)       (sizeof(x)/sizeof(*x))
 #define CLEANMASK(mask) (mask & ~(numlockmask | XCB_MOD_MASK_LOCK))
 #define BUTTONMASK      XCB_EVENT_MASK_BUTTON_PRESS|XCB_EVENT_MASK_BUTTON_RELEASE
-#define ISFMFTM(c)      (c->isfullscreen || c->ismaximized || c->isfloating || c->istransient || c->isminimized || c->type != ewmh->_NET_WM_WINDOW_TYPE_NORMAL)
 #define USAGE           "usage: frankenwm [-h] [-v]"
-/* future enhancements */
-#define MONITORS 1
+#define NET_STATES      12      /* other _NET_WM_STATE atoms kept per client */
 
 enum { RESIZE, MOVE };
 enum { TILE, MONOCLE, BSTACK, GRID, FIBONACCI, DUALSTACK, EQUAL, MODES };
@@ -62,6 +78,7 @@ struct list {
     struct node *head;
     struct node *tail;
     void        *master;    /* backpointer to the list's owner */
+    unsigned int gen;       /* bumped on every change to the list */
 };
 typedef struct list list;
 
@@ -86,6 +103,7 @@ struct alien {
     xcb_window_t win;
     xcb_atom_t type;
     posxy_t position_info;
+    pid_t pid;      /* its process, which is never stopped, see client_pid() */
 };
 typedef struct alien alien;
 
@@ -118,11 +136,27 @@ typedef struct {
  * holds some properties for that window
  *
  * link          - doubly linked list node
+ * minilink      - node in the display's queue of minimized clients
+ * urgentlink    - node in the global queue of urgent clients
  * isurgent      - set when the window received an urgent hint
  * istransient   - set when the window is transient
  * isfullscreen  - set when the window is fullscreen (not maximized)
  * ismaximized   - set when the window is maximized (not fullscreen)
  * isfloating    - set when the window is floating
+ * istiled       - derived from the above and the type by client_changed(),
+ *                 set when the layouts arrange the window
+ * ishidden      - set while hide_client() keeps the window unmapped
+ * nethidden     - _NET_WM_STATE_HIDDEN is published, see update_visibility()
+ * netfullscreen - _NET_WM_STATE_FULLSCREEN is published
+ * netstate      - the other atoms of its _NET_WM_STATE, set by the client or
+ *                 other tools, written back along with the two above
+ * netwrites     - _NET_WM_STATE writes whose property notify is still to come
+ * suspend       - its rule asks to stop the process while it is hidden
+ * isstopped     - the process was stopped by update_suspended()
+ * unmaps        - unmap notifications caused by hide_client() still to come
+ * pid           - the _NET_WM_PID of a client on this host, 0 if unknown
+ * hiddensince   - when update_suspended() saw it hidden first, in ms, or 0
+ * hints         - the cached WM_NORMAL_HINTS, see update_size_hints()
  * win           - the window this client is representing
  * type          - the _NET_WM_WINDOW_TYPE
  * dim           - the window dimensions when floating
@@ -137,7 +171,17 @@ typedef struct {
  */
 typedef struct {
     node link;  /* must be first */
-    bool isurgent, istransient, isfloating, isfullscreen, ismaximized, isminimized;
+    node minilink;
+    node urgentlink;
+    unsigned int isurgent:1, istransient:1, isfloating:1, isfullscreen:1,
+                 ismaximized:1, isminimized:1, istiled:1, ishidden:1,
+                 nethidden:1, netfullscreen:1, suspend:1, isstopped:1;
+    unsigned int unmaps;
+    xcb_atom_t netstate[NET_STATES];
+    unsigned int nnetstate, netwrites;
+    pid_t pid;
+    long hiddensince;
+    sizehints hints;
     xcb_window_t win;
     xcb_atom_t type;
     unsigned int dim[2];
@@ -145,6 +189,8 @@ typedef struct {
     int borderwidth;
     bool setfocus;
 } client;
+#define MINI_CLIENT(n)  ((client *)((char *)(n) - offsetof(client, minilink)))
+#define URGENT_CLIENT(n) ((client *)((char *)(n) - offsetof(client, urgentlink)))
 
 /* properties of each desktop
  * current      - the currently highlighted window
@@ -168,37 +214,84 @@ typedef struct {
 
 /* properties of each display
  * current      - the currently highlighted window
+ * tiled        - the tiled clients in list order, valid while tiledgen
+ *                matches clients.gen, see update_tiled()
+ * borders      - border widths of the tiled clients, input of the layout
+ * rects        - geometry of the tiled clients, output of the layout
+ * laid*        - the inputs of the last layout pass, which tile() skips
+ *                while they stay the same
+ * needslayout  - the layout has to run again, set to force it and by tile()
+ *                on hidden desktops, which are laid out once shown
  */
 typedef struct {
     node link;      /* must be first */
     list clients;   /* must be second */
     client *current, *prevfocus;
-    list miniq;
+    list miniq;     /* minimized clients, linked through client.minilink */
     displayinfo di;
+    client **tiled;
+    int *borders;
+    rect *rects;
+    unsigned int ntiled, tiledsize, tiledgen;
+    layoutparams laid;
+    int laidmode;
+    unsigned int laidgen;
+    bool needslayout;
 } display;
 #define M_CURRENT     (current_display->current)
 #define M_PREVFOCUS   (current_display->prevfocus)
-
+#define M_TILED       (current_display->tiled)
+#define M_NTILED      (current_display->ntiled)
+
+/* properties of each monitor
+ * num          - the output it shows, index into heads
+ * crtc         - the RandR CRTC of that output, 0 without RandR
+ * wx, wy       - origin of the work area on the screen
+ * ww, wh       - size of the work area
+ */
 typedef struct {
     node link;      /* must be first */
     list displays;  /* must be second */
     unsigned int num;
+    xcb_randr_crtc_t crtc;
     int ww, wh;
-    int wy;
+    int wx, wy;
 } monitor;
 
-/* desktop */
+/* desktop
+ * nurgent      - number of urgent clients on the desktop
+ * curmon       - the monitor that has the focus
+ */
 typedef struct {
     node link;      /* must be first */
     list monitors;  /* must be second */
     unsigned int num;
+    unsigned int nurgent;
+    monitor *curmon;
 } desktop;
 
-/* lifo for minimized clients */
-typedef struct lifo {
-    node link;      /* must be first */
-    client *c;
-} lifo;
+/*
+ * slab allocator for the objects that come and go with windows
+ *
+ * objects are carved out of blocks of POOL_BLOCK objects and recycled
+ * through a per-type free list, so window churn does not fragment the heap
+ * and objects of one type stay close to each other. blocks are only given
+ * back to the system on exit.
+ */
+#define POOL_BLOCK 64
+
+typedef union poolblock {
+    union poolblock *next;
+    long double align;      /* keep the objects behind the header aligned */
+} poolblock;
+
+typedef struct {
+    size_t size;            /* object size, at least one pointer */
+    void *free;             /* free list, linked through the objects */
+    poolblock *blocks;      /* all blocks ever allocated */
+} pool;
+
+#define POOL_INIT(type) { sizeof(type) < sizeof(void *) ? sizeof(void *) : sizeof(type), NULL, NULL }
 
 /* define behavior of certain applications
  * configured in config.h
@@ -206,6 +299,8 @@ typedef struct lifo {
  * instance - the instance of the window
  * desktop  - what desktop it should be spawned at
  * follow   - whether to change desktop focus to the specified desktop
+ * monitor  - what monitor it should be spawned at
+ * suspend  - whether to stop its process while its windows are hidden
  */
 typedef struct {
     const char *class;
@@ -213,8 +308,19 @@ typedef struct {
     const int desktop;
     const bool follow, floating;
     const int border_width;
+    const int monitor;
+    const bool suspend;
 } AppRule;
 
+/* a scratchpad, configured in config.h
+ * name     - the instance of its window
+ * com      - the command that opens it
+ */
+typedef struct {
+    const char *name;
+    const char **com;
+} Scratchpad;
+
  /* function prototypes sorted alphabetically */
 static client *addwindow(xcb_window_t w, xcb_atom_t wtype);
 static void adjust_borders(const Arg *arg);
@@ -236,13 +342,10 @@ static client *create_client(xcb_window_t win, xcb_atom_t wtype);
 static bool deletewindow(xcb_window_t w);
 static void desktopinfo(void);
 static void destroynotify(xcb_generic_event_t *e);
-static void dualstack(int hh, int cy);
 static void enternotify(xcb_generic_event_t *e);
-static void equal(int h, int y);
-static void fibonacci(int h, int y);
 static client *find_client(xcb_window_t w);
 static desktop *find_desktop(unsigned int n);
-/* static monitor *find_monitor(unsigned int n);  future enhancement */
+static monitor *find_monitor(unsigned int n);
 static void float_client(client *c);
 static void float_x(const Arg *arg);
 static void float_y(const Arg *arg);
@@ -251,7 +354,6 @@ static void focusurgent();
 static unsigned int getcolor(char *color);
 static void grabbuttons(client *c);
 static void grabkeys(void);
-static void grid(int h, int y);
 static void invertstack();
 static void keypress(xcb_generic_event_t *e);
 static void killclient();
@@ -261,7 +363,6 @@ static void maprequest(xcb_generic_event_t *e);
 static void maximize();
 static void minimize_client(client *c);
 static void minimize();
-static void monocle(int h, int y);
 static void move_down();
 static void move_up();
 static void mousemotion(const Arg *arg);
@@ -277,30 +378,56 @@ static void resize_y(const Arg *arg);
 static void restore_client(client *c);
 static void restore();
 static bool desktop_populated(desktop *d);
+static void update_occupancy(desktop *d);
+static void client_moved(client *c, desktop *from);
+static desktop *create_desktop(int d);
+static monitor *create_monitor(desktop *desk, int m);
+static void monitor_geometry(monitor *moni);
+static void pivot_display(display *disp);
+static void reclaim_desktop(desktop *desk);
+static void remove_monitor(monitor *moni, monitor *to, const xcb_rectangle_t *old);
+static void set_urgent(client *c, bool urgent);
 static void rotate(const Arg *arg);
 static void rotate_client(const Arg *arg);
 static void rotate_filled(const Arg *arg);
 static void rotate_mode(const Arg *arg);
+static void rotate_monitor(const Arg *arg);
 static void run(void);
+static void screenchangenotify(xcb_generic_event_t *e);
 static void select_desktop(int i);
+static void select_monitor(monitor *moni);
 static bool sendevent(xcb_window_t win, xcb_atom_t proto);
 static void setmaximize(client *c, bool fullscrn);
 void setfullscreen(client *c, bool fullscrn);
 static int setup(int default_screen);
 static void setup_display(void);
+static void setup_heads(void);
 static void setwindefattr(xcb_window_t w);
+static bool show_desktop(int i, client *newfocus);
 static void showhide();
 static void sigchld();
 static void spawn(const Arg *arg);
-static void stack(int h, int y);
 static void swap_master();
 static void switch_mode(const Arg *arg);
 static void tile(void);
+static void tile_display(display *disp);
 static void tilemize();
 static void togglepanel();
 static void unfloat_client(client *c);
-static void togglescratchpad();
+static void togglescratchpad(const Arg *arg);
+static void adopt_scratchpad(int n, xcb_window_t win, xcb_atom_t wtype);
+static int find_scratchpad(xcb_window_t win);
+static void spawn_scratchpad(int n);
 static void update_current(client *c);
+static void update_size_hints(client *c);
+static void update_desktopinfo(void);
+static void update_suspended(void);
+static long now_ms(void);
+static pid_t client_pid(xcb_window_t win);
+static bool arrange_current(client *newfocus);
+static void focus_current(void);
+static void update_tiled(display *disp);
+static void update_visibility(void);
 static void unmapnotify(xcb_generic_event_t *e);
 static void xerror(xcb_generic_event_t *e);
 static alien *wintoalien(list *l, xcb_window_t win);
@@ -318,35 +445,208 @@ typedef struct
 //    uint16_t bottom_start_x, bottom_end_x;
 } strut_t;
 
+/* window arrays backing _NET_CLIENT_LIST and _NET_CLIENT_LIST_STACKING
+ * wins     - the window ids
+ * num      - the number of valid entries
+ * size     - the allocated number of entries, only ever grows
+ */
+typedef struct {
+    xcb_window_t *wins;
+    unsigned int num, size;
+} winlist_t;
+
 static void Setup_EWMH_Taskbar_Support(void);
 static void Cleanup_EWMH_Taskbar_Support(void);
 static inline void Update_EWMH_Taskbar_Properties(void);
+static void Add_EWMH_Client(xcb_window_t win);
+static void Remove_EWMH_Client(xcb_window_t win);
+static void Update_EWMH_Client_List_Stacking(void);
 static void Setup_Global_Strut(void);
 static void Cleanup_Global_Strut(void);
 static inline void Reset_Global_Strut(void);
+static inline void Invalidate_Global_Strut(void);
 static void Update_Global_Strut(void);
 
-static strut_t gstrut;
+static winlist_t clientlist, stackinglist, stackingscratch;
+static strut_t *headstruts;     /* the struts reaching into each head */
+static int nheadstruts;
+static bool strut_stale = true; /* read the struts again before they are used */
 #endif /* EWMH_TASKBAR */
 
+/*
+ * binary state snapshot published in POSIX shared memory, see frankenwm(1)
+ *
+ * version  - SHM_STATE_VERSION, 0 once the window manager has quit
+ * size     - size of the whole snapshot in bytes
+ * seq      - seqlock counter, odd while the snapshot is being written,
+ *            readers can wait on it as a futex for the next change
+ * desktops - number of valid entries in desktop[]
+ * current  - the current desktop
+ * focused  - the focused window, 0 if there is none
+ * title    - the title of the focused window, always NUL terminated
+ */
+#define SHM_STATE_VERSION   1
+#define SHM_TITLE_LENGTH    256
+
+typedef struct {
+    uint32_t clients, mode, urgent, minimized;
+} shm_desktop_t;
+
+typedef struct {
+    uint32_t version, size;
+    uint32_t seq;
+    uint32_t desktops, current;
+    uint32_t focused;
+    char title[SHM_TITLE_LENGTH];
+    shm_desktop_t desktop[DESKTOPS];
+} shm_state_t;
+
+static void Setup_Shm_State(void);
+static void Cleanup_Shm_State(void);
+static void Update_Shm_State(void);
+
+static shm_state_t *shmstate = NULL;
+static xcb_window_t shmtitlewin = XCB_WINDOW_NONE;  /* whose title is cached */
+
+/* events IPC clients can subscribe to */
+enum { IPC_EV_FOCUS, IPC_EV_MANAGE, IPC_EV_UNMANAGE, IPC_EV_DESKTOP,
+       IPC_EV_MODE, IPC_EV_URGENCY, IPC_EVENTS };
+static const char *ipceventnames[IPC_EVENTS] = {
+    [IPC_EV_FOCUS] = "focus", [IPC_EV_MANAGE] = "manage",
+    [IPC_EV_UNMANAGE] = "unmanage", [IPC_EV_DESKTOP] = "desktop",
+    [IPC_EV_MODE] = "mode", [IPC_EV_URGENCY] = "urgency",
+};
+
+typedef struct {
+    int type;
+    uint32_t a, b;
+} ipcevent;
+
+/*
+ * a connection to the IPC socket, see frankenwm(1)
+ *
+ * fd       - the socket, -1 if the slot is unused
+ * in       - partial request line(s) read so far
+ * out      - response data not yet written to the socket
+ * events   - bitmask of the subscribed events
+ * queue    - ring of events not yet formatted into out
+ * overflow - events were dropped since the queue was last drained
+ */
+#define IPC_MAX_CLIENTS     16
+#define IPC_LINE_LENGTH     1024
+#define IPC_MAX_OUTPUT      (1 << 20)   /* drop clients that do not read */
+#define IPC_EVENT_QUEUE     64
+
+typedef struct {
+    int fd;
+    unsigned int inlen;
+    char in[IPC_LINE_LENGTH];
+    char *out;
+    unsigned int outlen, outsize;
+    unsigned int events;
+    ipcevent queue[IPC_EVENT_QUEUE];
+    unsigned int qhead, qlen;
+    bool overflow;
+} ipcclient;
+
+/* an action reachable through the IPC socket
+ * name     - the name of the command
+ * func     - the function to call
+ * argtype  - what kind of argument the function takes
+ */
+enum { IPC_NOARG, IPC_INT, IPC_DESKTOP, IPC_MODE, IPC_COMMAND };
+typedef struct {
+    const char *name;
+    void (*func)(const Arg *);
+    int argtype;
+} ipccommand;
+
+static void Setup_IPC(void);
+static void Cleanup_IPC(void);
+static void Wait_IPC(int timeout);
+static void Emit_IPC_Event(int type, uint32_t a, uint32_t b);
+
+static int ipcfd = -1;
+static char ipcpath[sizeof(((struct sockaddr_un *)0)->sun_path)];
+static ipcclient ipcclients[IPC_MAX_CLIENTS];
+static unsigned int ipcsubscribed;  /* union of all subscriptions */
+
+static const ipccommand ipccommands[] = {
+    { "adjust_borders",     adjust_borders,     IPC_INT },
+    { "adjust_gaps",        adjust_gaps,        IPC_INT },
+    { "centerwindow",       centerwindow,       IPC_NOARG },
+    { "change_desktop",     change_desktop,     IPC_DESKTOP },
+    { "client_to_desktop",  client_to_desktop,  IPC_DESKTOP },
+    { "float_x",            float_x,            IPC_INT },
+    { "float_y",            float_y,            IPC_INT },
+    { "focusmaster",        focusmaster,        IPC_NOARG },
+    { "focusurgent",        focusurgent,        IPC_NOARG },
+    { "invertstack",        invertstack,        IPC_NOARG },
+    { "killclient",         killclient,         IPC_NOARG },
+    { "last_desktop",       last_desktop,       IPC_NOARG },
+    { "maximize",           maximize,           IPC_NOARG },
+    { "minimize",           minimize,           IPC_NOARG },
+    { "move_down",          move_down,          IPC_NOARG },
+    { "move_up",            move_up,            IPC_NOARG },
+    { "next_win",           next_win,           IPC_NOARG },
+    { "prev_win",           prev_win,           IPC_NOARG },
+    { "quit",               quit,               IPC_INT },
+    { "resize_master",      resize_master,      IPC_INT },
+    { "resize_stack",       resize_stack,       IPC_INT },
+    { "resize_x",           resize_x,           IPC_INT },
+    { "resize_y",           resize_y,           IPC_INT },
+    { "restore",            restore,            IPC_NOARG },
+    { "rotate",             rotate,             IPC_INT },
+    { "rotate_client",      rotate_client,      IPC_INT },
+    { "rotate_filled",      rotate_filled,      IPC_INT },
+    { "rotate_mode",        rotate_mode,        IPC_INT },
+    { "rotate_monitor",     rotate_monitor,     IPC_INT },
+    { "showhide",           showhide,           IPC_NOARG },
+    { "spawn",              spawn,              IPC_COMMAND },
+    { "swap_master",        swap_master,        IPC_NOARG },
+    { "switch_mode",        switch_mode,        IPC_MODE },
+    { "tilemize",           tilemize,           IPC_NOARG },
+    { "togglepanel",        togglepanel,        IPC_NOARG },
+    { "togglescratchpad",   togglescratchpad,   IPC_INT },
+};
+
 /* variables */
+extern char **environ;   /* passed on to spawned commands */
 static bool running = true, show = true, showscratchpad = false;
+static bool visibility_stale;   /* run update_visibility() before the next flush */
+static bool desktopinfo_stale;  /* run update_desktopinfo() before the next flush */
+static bool suspending;         /* a rule or SUSPEND_DESKTOPS stops hidden processes */
+static bool suspend_stale;      /* run update_suspended() before waiting for events */
+static long suspend_deadline;   /* when update_suspended() is due again, 0 if never */
 static int default_screen, previous_desktop, current_desktop_number, retval;
+static int shown_desktop;   /* the desktop on screen, select_desktop() does not change it */
 static int borders;
 static unsigned int numlockmask, win_unfocus, win_focus, win_scratch;
 static xcb_connection_t *dis;
 static xcb_screen_t *screen;
 static uint32_t checkwin;
 static xcb_atom_t scrpd_atom;
-static client *scrpd = NULL;
+static client *scrpd = NULL;       /* the shown or last shown scratchpad */
 static list desktops;
+static desktop *desktop_index[DESKTOPS];    /* desktops by number, NULL until used */
+static displayinfo defaultdi;                /* settings of newly created desktops */
+#define OCC_BITS      ((int)(8 * sizeof(unsigned long)))
+static unsigned long occupied[(DESKTOPS + OCC_BITS - 1) / OCC_BITS];  /* desktops with clients */
 static list aliens;
+static list urgents;    /* urgent clients, oldest first */
+static pool clientpool = POOL_INIT(client);
+static pool alienpool = POOL_INIT(alien);
+static pool displaypool = POOL_INIT(display);
 
 static desktop *current_desktop = NULL;
 
 static monitor *current_monitor = NULL;
+static xcb_rectangle_t *heads;  /* geometry of the outputs, one monitor each */
+static xcb_randr_crtc_t *headcrtcs;     /* their RandR CRTCs, 0 without RandR */
+static int nheads;
 #define M_WW          (current_monitor->ww)
 #define M_WH          (current_monitor->wh)
+#define M_WX          (current_monitor->wx)
 #define M_WY          (current_monitor->wy)
 
 static display *current_display = NULL;
@@ -357,6 +657,10 @@ static xcb_ewmh_connection_t *ewmh;
 static xcb_atom_t wmatoms[WM_COUNT];
 static regex_t classruleregex[LENGTH(rules)];
 static regex_t instanceruleregex[LENGTH(rules)];
+static client *scrpds[LENGTH(scratchpads)];     /* the scratchpad windows, NULL while missing */
+static bool scrpdstarting[LENGTH(scratchpads)]; /* the command runs, the window is yet to come */
+static long scrpdstarted[LENGTH(scratchpads)];  /* now_ms() of the last start */
+static int scrpdpending = -1;   /* the scratchpad to show once its window maps */
 static xcb_key_symbols_t *keysyms;
 
 /* events array
@@ -364,17 +668,16 @@ static xcb_key_symbols_t *keysyms;
  */
 static void (*events[XCB_NO_OPERATION])(xcb_generic_event_t *e);
 
-/* layout array - given the current layout mode, tile the windows
- * h (or hh) - avaible height that windows have to expand
- * y (or cy) - offset from top to place the windows (reserved by the panel) */
-static void (*layout[MODES])(int h, int y) = {
-    [TILE] = stack,
-    [BSTACK] = stack,
-    [GRID] = grid,
-    [MONOCLE] = monocle,
-    [FIBONACCI] = fibonacci,
-    [DUALSTACK] = dualstack,
-    [EQUAL] = equal,
+/* layout array - given the current layout mode, the kernel that computes
+ * the geometry of the tiled windows, see layout.h */
+static const layoutkernel layout[MODES] = {
+    [TILE] = layout_stack,
+    [BSTACK] = layout_bstack,
+    [GRID] = layout_grid,
+    [MONOCLE] = layout_monocle,
+    [FIBONACCI] = layout_fibonacci,
+    [DUALSTACK] = layout_dualstack,
+    [EQUAL] = layout_equal,
 };
 
 /*
@@ -389,6 +692,7 @@ static node *rem_node(node *n)
         return NULL;
     l = n->parent;
     if (l) {
+        l->gen++;
         if (n == l->head) {
             l->head = l->head->next;
             if(l->head)
@@ -424,6 +728,7 @@ static void add_head(list *l, node *i)
         o->prev = i;
     }
     i->parent = l;
+    l->gen++;
 }
 
 static void add_tail(list *l, node *i)
@@ -436,6 +741,7 @@ static void add_tail(list *l, node *i)
         o->next = i;
         i->prev = o;
         i->next = NULL;
+        l->gen++;
     }
     i->parent = l;
 }
@@ -450,6 +756,7 @@ static void insert_node_after(list *l, node *c, node *i)
         i->prev = c;
         i->next = n;
         n->prev = i;
+        l->gen++;
     }
     i->parent = l;
 }
@@ -464,6 +771,7 @@ static void insert_node_before(list *l, node *c, node *i)
         i->prev = p;
         i->next = c;
         c->prev = i;
+        l->gen++;
     }
     i->parent = l;
 }
@@ -489,13 +797,65 @@ static inline node *get_node_head(node *n) { return (n && n->parent) ? n->parent
 #define M_GETPREV(c)  ((client *)get_prev(&c->link))
 
 /*
- * Add an atom to a list of atoms the given property defines.
- * This is useful, for example, for manipulating _NET_WM_STATE.
- *
+ * rederive the tiled bit of a client, call after any change to its floating,
+ * fullscreen, maximized, minimized or transient state. if the bit flips, the
+ * tiled array of the client's display is stale.
+ */
+static inline void client_changed(client *c)
+{
+    bool tiled = !(c->isfullscreen || c->ismaximized || c->isfloating || c->istransient
+                   || c->isminimized || c->type != ewmh->_NET_WM_WINDOW_TYPE_NORMAL);
+
+    if (c->istiled == tiled)
+        return;
+    c->istiled = tiled;
+    if (c->link.parent)
+        c->link.parent->gen++;
+}
+
+/*
+ * slab allocator functions
  */
-void xcb_add_property(xcb_connection_t *con, xcb_window_t win, xcb_atom_t prop, xcb_atom_t atom)
+
+/* zeroed object from the pool, NULL if memory is exhausted */
+static void *pool_alloc(pool *p)
+{
+    void *o;
+
+    if (!p->free) {
+        poolblock *b = malloc(sizeof(poolblock) + POOL_BLOCK * p->size);
+        char *objs;
+
+        if (!b)
+            return NULL;
+        b->next = p->blocks;
+        p->blocks = b;
+        objs = (char *)(b + 1);
+        for (int i = POOL_BLOCK - 1; i >= 0; i--) {
+            *(void **)(objs + i * p->size) = p->free;
+            p->free = objs + i * p->size;
+        }
+    }
+    o = p->free;
+    p->free = *(void **)o;
+    return memset(o, 0, p->size);
+}
+
+static void pool_free(pool *p, void *o)
+{
+    if (!o)
+        return;
+    *(void **)o = p->free;
+    p->free = o;
+}
+
+static void pool_destroy(pool *p)
 {
-    xcb_change_property(con, XCB_PROP_MODE_APPEND, win, prop, XCB_ATOM_ATOM, 32, 1, (uint32_t[]){atom});
+    for (poolblock *b = p->blocks, *n; b; b = n) {
+        n = b->next;
+        free(b);
+    }
+    p->blocks = p->free = NULL;
 }
 
 /*
@@ -618,6 +978,119 @@ static inline void xcb_resize(xcb_connection_t *con, xcb_window_t win, int w,
     xcb_configure_window(con, win, XCB_RESIZE, pos);
 }
 
+/* set the ICCCM WM_STATE of a window */
+static inline void set_wm_state(xcb_window_t win, uint32_t state)
+{
+    uint32_t data[] = { state, XCB_NONE };
+
+    xcb_change_property(dis, XCB_PROP_MODE_REPLACE, win, wmatoms[WM_STATE],
+                        wmatoms[WM_STATE], 32, 2, data);
+}
+
+/*
+ * hide the window of a client that is not on screen, if UNMAP_HIDDEN is set
+ * it is unmapped and stops drawing, else it is moved offscreen
+ */
+static void hide_client(client *c)
+{
+    if (!UNMAP_HIDDEN) {
+        xcb_move(dis, c->win, -2 * M_WW, 0, &c->position_info);
+        if (c->istiled)     /* tile() must not take it for laid out */
+            ((display *)c->link.parent->master)->needslayout = true;
+    } else if (!c->ishidden) {
+        c->ishidden = true;
+        c->unmaps++;    /* not a withdrawal, see unmapnotify() */
+        xcb_unmap_window(dis, c->win);
+        set_wm_state(c->win, XCB_ICCCM_WM_STATE_ICONIC);
+    }
+}
+
+/* bring back a window hidden by hide_client(), minimized ones stay hidden */
+static void show_client(client *c)
+{
+    if (!UNMAP_HIDDEN) {
+        xcb_move(dis, c->win, c->position_info.previous_x, c->position_info.previous_y, &c->position_info);
+    } else if (c->ishidden && !c->isminimized) {
+        c->ishidden = false;
+        xcb_map_window(dis, c->win);
+        set_wm_state(c->win, XCB_ICCCM_WM_STATE_NORMAL);
+    }
+}
+
+/* write the _NET_WM_STATE of a client from its cached atoms, needs no reply */
+static void write_net_wm_state(client *c)
+{
+    xcb_atom_t data[NET_STATES + 2];
+    unsigned int n = c->nnetstate;
+
+    memcpy(data, c->netstate, n * sizeof(xcb_atom_t));
+    if (c->netfullscreen)
+        data[n++] = ewmh->_NET_WM_STATE_FULLSCREEN;
+    if (c->nethidden)
+        data[n++] = ewmh->_NET_WM_STATE_HIDDEN;
+    c->netwrites++;     /* not news to propertynotify() */
+    xcb_change_property(dis, XCB_PROP_MODE_REPLACE, c->win, ewmh->_NET_WM_STATE,
+                        XCB_ATOM_ATOM, 32, n, data);
+}
+
+/*
+ * read the _NET_WM_STATE of a client into its cache. the fullscreen and
+ * hidden atoms are taken as published, update_visibility() corrects them.
+ */
+static void read_net_wm_state(client *c)
+{
+    xcb_get_property_reply_t *r = xcb_get_property_reply(dis, xcb_get_property_unchecked(dis,
+                    0, c->win, ewmh->_NET_WM_STATE, XCB_ATOM_ATOM, 0, NET_STATES + 2), NULL);
+
+    c->nnetstate = 0;
+    c->nethidden = c->netfullscreen = false;
+    if (!r)
+        return;
+    if (r->format == 32) {
+        xcb_atom_t *v = xcb_get_property_value(r);
+        for (unsigned int i = 0; i < r->value_len; i++) {
+            unsigned int j;
+            if (v[i] == ewmh->_NET_WM_STATE_FULLSCREEN)
+                c->netfullscreen = true;
+            else if (v[i] == ewmh->_NET_WM_STATE_HIDDEN)
+                c->nethidden = true;
+            else {
+                for (j = 0; j < c->nnetstate && c->netstate[j] != v[i]; j++) ;
+                if (j == c->nnetstate && j < NET_STATES)
+                    c->netstate[c->nnetstate++] = v[i];
+            }
+        }
+    }
+    free(r);
+}
+
+/* add, remove or toggle one of the other _NET_WM_STATE atoms of a client */
+static void change_net_wm_state(client *c, xcb_atom_t atom, uint32_t action)
+{
+    unsigned int i;
+
+    for (i = 0; i < c->nnetstate && c->netstate[i] != atom; i++) ;
+    if (action == _NET_WM_STATE_TOGGLE)
+        action = i < c->nnetstate ? _NET_WM_STATE_REMOVE : _NET_WM_STATE_ADD;
+    if (action == _NET_WM_STATE_ADD && i == c->nnetstate && i < NET_STATES)
+        c->netstate[c->nnetstate++] = atom;
+    else if (action == _NET_WM_STATE_REMOVE && i < c->nnetstate)
+        c->netstate[i] = c->netstate[--c->nnetstate];
+    else
+        return;
+    write_net_wm_state(c);
+}
+
+/* update the _NET_WM_STATE of a client, if it differs from what it was */
+static void set_net_wm_state(client *c, bool hidden)
+{
+    if (c->nethidden == hidden && c->netfullscreen == c->isfullscreen)
+        return;
+    c->nethidden = hidden;
+    c->netfullscreen = c->isfullscreen;
+    write_net_wm_state(c);
+}
+
 /* wrapper to raise window */
 static inline void xcb_raise_window(xcb_connection_t *con, xcb_window_t win)
 {
@@ -759,14 +1232,10 @@ static client *find_client(xcb_window_t w)
 /* find desktop by number */
 static desktop *find_desktop(unsigned int n)
 {
-    desktop *d;
-    for (d = (desktop *)get_head(&desktops);
-            d && d->num != n; d = (desktop *)get_next(&d->link)) ;
-    return d;
+    return (n < DESKTOPS) ? desktop_index[n] : NULL;
 }
 
 /* find monitor in current_desktop by number */
-/*
 static monitor *find_monitor(unsigned int n)
 {
     monitor *m;
@@ -774,7 +1243,49 @@ static monitor *find_monitor(unsigned int n)
             m && m->num != n; m = (monitor *)get_next(&m->link)) ;
     return m;
 }
-*/
+
+/* find the monitor of current_desktop showing the point x, y */
+static monitor *monitor_at(int x, int y)
+{
+    monitor *m;
+    for (m = (monitor *)get_head(&current_desktop->monitors); m; m = (monitor *)get_next(&m->link)) {
+        xcb_rectangle_t *h = &heads[m->num];
+        if (x >= h->x && x < h->x + h->width && y >= h->y && y < h->y + h->height)
+            break;
+    }
+    return m;
+}
+
+/* the monitor of current_desktop under the pointer, NULL if there is none */
+static monitor *pointer_monitor(void)
+{
+    if (nheads < 2)
+        return NULL;
+
+    xcb_query_pointer_reply_t *r = xcb_query_pointer_reply(dis,
+                                        xcb_query_pointer(dis, screen->root), NULL);
+    monitor *m = NULL;
+
+    if (r) {
+        m = monitor_at(r->root_x, r->root_y);
+        free(r);
+    }
+    return m;
+}
+
+/*
+ * give the focus to another monitor of the current desktop, the current
+ * window of the monitor left behind loses its highlight
+ */
+static void select_monitor(monitor *moni)
+{
+    if (!moni || moni == current_monitor)
+        return;
+    if (M_CURRENT && M_CURRENT != scrpd)
+        xcb_change_window_attributes(dis, M_CURRENT->win, XCB_CW_BORDER_PIXEL, &win_unfocus);
+    current_desktop->curmon = current_monitor = moni;
+    current_display = (display *)get_head(&current_monitor->displays);
+}
 
 static void getparents(client *c, display **di, monitor **mo, desktop **de)
 {
@@ -817,8 +1328,13 @@ client *addwindow(xcb_window_t win, xcb_atom_t wtype)
         else
             add_tail(&current_display->clients, &c->link);
     }
+    update_occupancy(current_desktop);
     DEBUG("client added");
     setwindefattr(win);
+#ifdef EWMH_TASKBAR
+    Add_EWMH_Client(win);
+#endif /* EWMH_TASKBAR */
+    Emit_IPC_Event(IPC_EV_MANAGE, win, current_desktop_number);
     return c;
 }
 
@@ -843,6 +1359,7 @@ void adjust_gaps(const Arg *arg)
 
     if (GLOBALGAPS) {
         desktop *desk;
+        defaultdi.gaps = gaps;      /* for desktops created later */
         for (desk = (desktop *)get_head(&desktops); desk; desk = (desktop *)get_next(&desk->link)) {
             monitor *moni;
             for (moni = (monitor *)get_head(&desk->monitors); moni; moni = (monitor *)get_next(&moni->link)) {
@@ -892,38 +1409,64 @@ void buttonpress(xcb_generic_event_t *e)
     }
 }
 
-/* focus another desktop
- *
- * to avoid flickering
- * first map the new windows
- * first the current window and then all other
- * then unmap the old windows
- * first all others then the current */
+/* focus another desktop */
 void change_desktop(const Arg *arg)
 {
     if (arg->i == current_desktop_number || arg->i > DESKTOPS-1)
         return;
+    if (show_desktop(arg->i, NULL))
+        focus_current();
+}
+
+/* show desktop i, with newfocus as its current window if set
+ *
+ * the new state is built up front and goes out as one burst with the
+ * next flush, in the order
+ * hide the old windows, first all others then the current
+ * lay out, border and restack the new windows while they are hidden
+ * show the new windows, first the current window and then all other
+ * tell the pagers from run(), after everything else
+ * the caller focuses the current window if this returns true */
+static bool show_desktop(int i, client *newfocus)
+{
+    desktop *old = current_desktop;
+    bool focus = false;
     previous_desktop = current_desktop_number;
-    select_desktop(arg->i);
-    if (show) {
-        if (M_CURRENT && M_CURRENT != scrpd)
-            xcb_move(dis, M_CURRENT->win, M_CURRENT->position_info.previous_x, M_CURRENT->position_info.previous_y, &M_CURRENT->position_info);
-        for (client *c = M_HEAD; c; c = M_GETNEXT(c)) {
-            if (c != M_CURRENT)
-                xcb_move(dis, c->win, c->position_info.previous_x, c->position_info.previous_y, &c->position_info);
+    select_desktop(i);
+    shown_desktop = i;
+    for (monitor *moni = (monitor *)get_head(&old->monitors); moni;
+            moni = (monitor *)get_next(&moni->link)) {
+        display *disp = (display *)get_head(&moni->displays);
+        for (client *c = (client *)get_head(&disp->clients); c; c = M_GETNEXT(c)) {
+            if (c != disp->current)
+                hide_client(c);
         }
+        if (disp->current && disp->current != scrpd)
+            hide_client(disp->current);
     }
-    select_desktop(previous_desktop);
-    for (client *c = M_HEAD; c; c = M_GETNEXT(c)) {
-        if (c != M_CURRENT)
-            xcb_move(dis, c->win, -2 * M_WW, 0, &c->position_info);
+    for (monitor *moni = (monitor *)get_head(&current_desktop->monitors); moni;
+            moni = (monitor *)get_next(&moni->link)) {
+        display *disp = (display *)get_head(&moni->displays);
+        disp->needslayout = true;   /* tile() places the tiled windows */
+        if (moni == current_desktop->curmon)
+            focus = arrange_current(newfocus ? newfocus : M_CURRENT);
+        else
+            tile_display(disp);
+        if (show) {
+            client *cur = disp->current;
+            if (cur && cur != scrpd && (UNMAP_HIDDEN || !cur->istiled))
+                show_client(cur);
+            for (client *c = (client *)get_head(&disp->clients); c; c = M_GETNEXT(c)) {
+                if (c != cur && (UNMAP_HIDDEN || !c->istiled))
+                    show_client(c);
+            }
+        }
     }
-    if (M_CURRENT && M_CURRENT != scrpd)
-        xcb_move(dis, M_CURRENT->win, -2 * M_WW, 0, &M_CURRENT->position_info);
-    select_desktop(arg->i);
-    update_current(M_CURRENT);
-    desktopinfo();
-    xcb_ewmh_set_current_desktop(ewmh, default_screen, arg->i);
+    select_desktop(i);
+    reclaim_desktop(old);
+    suspend_stale = suspending;
+    desktopinfo();      /* also sets _NET_CURRENT_DESKTOP */
+    return focus;
 }
 
 static void print_window_type(xcb_window_t w, xcb_atom_t a)
@@ -1022,8 +1565,8 @@ static void centerfloating(client *c)
 
     xcb_get_geometry_reply_t *wa = get_geometry(c->win);
     xcb_raise_window(dis, c->win);
-    xcb_move(dis, c->win, ((M_WW - wa->width) / 2) - c->borderwidth,
-                     ((M_WH - wa->height) / 2) - c->borderwidth, &c->position_info);
+    xcb_move(dis, c->win, M_WX + ((M_WW - wa->width) / 2) - c->borderwidth,
+                     M_WY + ((M_WH - wa->height) / 2) - c->borderwidth, &c->position_info);
     free(wa);
 }
 
@@ -1047,24 +1590,34 @@ void centerwindow(void)
 /* remove all windows in all desktops by sending a delete message */
 void cleanup(void)
 {
+    if (suspending)
+        update_suspended();     /* not running, so every process continues */
 #ifdef EWMH_TASKBAR
     Cleanup_Global_Strut();
     Cleanup_EWMH_Taskbar_Support();
 #endif /* EWMH_TASKBAR */
+    Cleanup_Shm_State();
+    Cleanup_IPC();
 
-    if(USE_SCRATCHPAD && scrpd) {
+    for (unsigned int i = 0; USE_SCRATCHPAD && i < LENGTH(scratchpads); i++) {
+        client *s = scrpds[i];
+        if (!s)
+            continue;
         if(CLOSE_SCRATCHPAD) {
-            deletewindow(scrpd->win);
+            deletewindow(s->win);
         }
         else {
-            xcb_border_width(dis, scrpd->win, 0);
-            xcb_get_geometry_reply_t *wa = get_geometry(scrpd->win);
-            xcb_move(dis, scrpd->win, (M_WW - wa->width) / 2, (M_WH - wa->height) / 2, &scrpd->position_info);
-            free(wa);
+            xcb_border_width(dis, s->win, 0);
+            if (s == scrpd && showscratchpad) {     /* the others stay where they wait */
+                xcb_get_geometry_reply_t *wa = get_geometry(s->win);
+                xcb_move(dis, s->win, M_WX + (M_WW - wa->width) / 2, M_WY + (M_WH - wa->height) / 2, &s->position_info);
+                free(wa);
+            }
         }
-        free(scrpd);
-        scrpd = NULL;
+        pool_free(&clientpool, s);
+        scrpds[i] = NULL;
     }
+    scrpd = NULL;
 
     xcb_ewmh_connection_wipe(ewmh);
 
@@ -1082,7 +1635,11 @@ void cleanup(void)
 
     alien *a;
     while ((a = (alien *)rem_head(&aliens)))
-        free(a);
+        pool_free(&alienpool, a);
+
+    pool_destroy(&clientpool);
+    pool_destroy(&alienpool);
+    pool_destroy(&displaypool);
 }
 
 static void cleanup_display(void)
@@ -1095,18 +1652,26 @@ static void cleanup_display(void)
             for (disp = (display *)rem_head(&moni->displays); disp; disp = (display *)rem_head(&moni->displays)) {
                 client *c;
                 for (c = (client *)rem_head(&disp->clients); c; c = (client *)rem_head(&disp->clients)) {
+                    rem_node(&c->urgentlink);
                     xcb_border_width(dis, c->win, 0);
-                    free(c);
+                    pool_free(&clientpool, c);
                 }
-                for (struct lifo *l = (lifo *)rem_head(&disp->miniq); l; l = (lifo *)rem_head(&disp->miniq))
-                    free(l);
+                while (rem_head(&disp->miniq))
+                    ;
 
-                free(disp);
+                free(disp->tiled);
+                free(disp->borders);
+                free(disp->rects);
+                pool_free(&displaypool, disp);
             }
             free(moni);
         }
         free(desk);
     }
+    free(heads);
+    free(headcrtcs);
+    heads = NULL;
+    headcrtcs = NULL;
 }
 
 /*
@@ -1135,7 +1700,8 @@ void client_to_desktop(const Arg *arg)
     select_desktop(arg->i);
     add_tail(&current_display->clients, &c->link);
     select_desktop(cd);
-    xcb_move(dis, c->win, -2 * M_WW, 0, &c->position_info);
+    client_moved(c, current_desktop);
+    hide_client(c);
     xcb_ewmh_set_wm_desktop(ewmh, c->win, arg->i);
 
     if (FOLLOW_WINDOW)
@@ -1194,6 +1760,11 @@ void clientmessage(xcb_generic_event_t *e)
                 break;
             }
         }
+        for (int i = 1; i < 3; i++) {   /* the states kept for the client */
+            xcb_atom_t a = ev->data.data32[i];
+            if (a && a != ewmh->_NET_WM_STATE_FULLSCREEN && a != ewmh->_NET_WM_STATE_HIDDEN)
+                change_net_wm_state(c, a, ev->data.data32[0]);
+        }
     }
     else {
         if (ev->type == ewmh->_NET_CURRENT_DESKTOP
@@ -1270,18 +1841,37 @@ void configurerequest(xcb_generic_event_t *e)
         if (ev->value_mask & XCB_CONFIG_WINDOW_STACK_MODE)
             v[i++] = ev->stack_mode;
         xcb_configure_window(dis, ev->window, ev->value_mask, v);
+        if (c && c->istiled) {  /* the layout has to put it back */
+            display *disp;
+            getparents(c, &disp, NULL, NULL);
+            disp->needslayout = true;
+        }
     }
     tile();
 }
 
+/* a dock came or went, with it its struts */
+static void dock_changed(alien *a)
+{
+#ifdef EWMH_TASKBAR
+    if (a->type != ewmh->_NET_WM_WINDOW_TYPE_DOCK)
+        return;
+    Invalidate_Global_Strut();
+    tile();
+#else
+    (void)a;
+#endif /* EWMH_TASKBAR */
+}
+
 static inline alien *create_alien(xcb_window_t win, xcb_atom_t atom)
 {
     alien *a;
-    if((a = (alien *)calloc(1, sizeof(alien)))) {
+    if((a = (alien *)pool_alloc(&alienpool))) {
         unsigned int values[1] = { XCB_EVENT_MASK_PROPERTY_CHANGE };
         xcb_change_window_attributes(dis, win, XCB_CW_EVENT_MASK, values);
         a->win = win;
         a->type = atom;
+        a->pid = suspending ? client_pid(win) : 0;
         add_tail(&aliens, &a->link);
         xcb_raise_window(dis, win);
         xcb_map_window(dis, win);
@@ -1290,10 +1880,48 @@ static inline alien *create_alien(xcb_window_t win, xcb_atom_t atom)
         a->position_info.previous_x = a->position_info.current_x = g->x;
         a->position_info.previous_y = a->position_info.current_y = g->y;
         free(g);
+        dock_changed(a);
     }
     return(a);
 }
 
+/*
+ * fetch the WM_NORMAL_HINTS of a client. as ICCCM says, a missing base
+ * size defaults to the minimum size and the other way round.
+ */
+static void update_size_hints(client *c)
+{
+    xcb_size_hints_t sh;
+    sizehints *h = &c->hints;
+
+    memset(h, 0, sizeof(sizehints));
+    if (!xcb_icccm_get_wm_normal_hints_reply(dis,
+            xcb_icccm_get_wm_normal_hints_unchecked(dis, c->win), &sh, NULL))
+        return;
+    if (sh.flags & XCB_ICCCM_SIZE_HINT_BASE_SIZE) {
+        h->basew = sh.base_width;
+        h->baseh = sh.base_height;
+    } else if (sh.flags & XCB_ICCCM_SIZE_HINT_P_MIN_SIZE) {
+        h->basew = sh.min_width;
+        h->baseh = sh.min_height;
+    }
+    if (sh.flags & XCB_ICCCM_SIZE_HINT_P_MIN_SIZE) {
+        h->minw = sh.min_width;
+        h->minh = sh.min_height;
+    } else if (sh.flags & XCB_ICCCM_SIZE_HINT_BASE_SIZE) {
+        h->minw = sh.base_width;
+        h->minh = sh.base_height;
+    }
+    if (sh.flags & XCB_ICCCM_SIZE_HINT_P_RESIZE_INC) {
+        h->incw = sh.width_inc;
+        h->inch = sh.height_inc;
+    }
+    if (sh.flags & XCB_ICCCM_SIZE_HINT_P_MAX_SIZE) {
+        h->maxw = sh.max_width;
+        h->maxh = sh.max_height;
+    }
+}
+
 /*
  * allocate client structure and fill in sane defaults
  * exit FrankenWM if memory allocation fails
@@ -1301,7 +1929,7 @@ static inline alien *create_alien(xcb_window_t win, xcb_atom_t atom)
 static client *create_client(xcb_window_t win, xcb_atom_t wtype)
 {
     xcb_icccm_wm_hints_t hints;
-    client *c = calloc(1, sizeof(client));
+    client *c = pool_alloc(&clientpool);
     if (!c)
         err(EXIT_FAILURE, "cannot allocate client");
     c->isurgent = False;
@@ -1310,14 +1938,24 @@ static client *create_client(xcb_window_t win, xcb_atom_t wtype)
     c->ismaximized = False;
     c->isfloating = False;
     c->isminimized = False;
+    c->ishidden = False;
+    c->netwrites = 0;
+    read_net_wm_state(c);
+    c->suspend = False;
+    c->isstopped = False;
+    c->unmaps = 0;
+    c->pid = suspending ? client_pid(win) : 0;
+    c->hiddensince = 0;
     c->win = win;
     c->type = wtype;
+    client_changed(c);
     c->dim[0] = c->dim[1] = 0;
     c->borderwidth = -1;    /* default: use global border width */
     c->setfocus = True;     /* default: prefer xcb_set_input_focus(); */
     if (xcb_icccm_get_wm_hints_reply(dis,
             xcb_icccm_get_wm_hints(dis, win), &hints, NULL))
         c->setfocus = (hints.input) ? True : False;
+    update_size_hints(c);
 
     xcb_get_geometry_reply_t *g = get_geometry(c->win);
     c->position_info.previous_x = c->position_info.current_x = g->x;
@@ -1336,12 +1974,12 @@ static void create_display(client *c)
     if (!c)
         return;
     getparents(c, &disp, &moni, &desk);     /* get the client's display, monitor and desktop. */
-    if (!(new = calloc(1, sizeof(display))))
+    if (!(new = pool_alloc(&displaypool)))
         err(EXIT_FAILURE, "cannot allocate new display");
     new->clients.master = new;  /* backpointer */
     rem_node(&c->link);          /* unlink client from its display client list. */
     for (client *t = M_HEAD; t; t = M_GETNEXT(t))   /* hide current windows */
-        xcb_move(dis, t->win, -2 * M_WW, 0, &t->position_info);
+        hide_client(t);
     for (alien *t = (alien *)get_head(&aliens); t; t = (alien *)get_next(&t->link))   /* hide aliens */
         xcb_move(dis, t->win, -2 * M_WW, 0, &t->position_info);
     add_head(&new->clients, &c->link);      /* set client as head in new display */
@@ -1372,10 +2010,14 @@ bool deletewindow(xcb_window_t win)
  *   and the current window's title
  *
  * once the info is collected, immediately flush the stream
+ *
+ * the same information is published as shared memory snapshot if enabled
+ * and changes of focus, desktop and mode are sent to IPC subscribers
  */
-void desktopinfo(void)
+static void update_desktopinfo(void)
 {
-    bool urgent = false;
+    static xcb_window_t lastfocus = XCB_WINDOW_NONE;
+    static int lastdesktop = -1, lastmode = -1;
     int cd = current_desktop_number, n = 0, d = 0, minimized = 0;
     xcb_get_property_cookie_t cookie;
     xcb_ewmh_get_utf8_strings_reply_t wclass;
@@ -1387,31 +2029,59 @@ void desktopinfo(void)
             xcb_ewmh_get_wm_name_reply(ewmh, cookie, &wclass, (void *)0);
         }
 
-        for (client *c; d < DESKTOPS; d++) {
-            for (select_desktop(d), c = M_HEAD, n = 0, urgent = false, minimized = 0;
-                 c; c = M_GETNEXT(c), ++n) {
-                if (c->isurgent)
-                    urgent = true;
-                minimized += c->isminimized;
+        /* desktops that were not used yet are reported with the defaults */
+        for (; d < DESKTOPS; d++) {
+            desktop *desk = find_desktop(d);
+            display *disp = NULL;
+            int mode = defaultdi.mode;
+
+            n = minimized = 0;
+            if (desk) {
+                disp = (display *)get_head(&((monitor *)get_head(&desk->monitors))->displays);
+                mode = disp->di.mode;
             }
-            fprintf(stdout, "%d:%d:%d:%d:%d:%d ", d, n, M_MODE,
-                    current_desktop_number == cd, urgent, minimized);
-            if (d + 1 == DESKTOPS)
-                fprintf(stdout, "%s\n", M_CURRENT && OUTPUT_TITLE && wclass.strings ?
-                        wclass.strings : "");
+            for (client *c = disp ? (client *)get_head(&disp->clients) : NULL; c; c = M_GETNEXT(c), ++n)
+                minimized += c->isminimized;
+            fprintf(stdout, "%d:%d:%d:%d:%d:%d ", d, n, mode,
+                    d == cd, desk && desk->nurgent, minimized);
         }
+        fprintf(stdout, "%s\n", M_CURRENT && OUTPUT_TITLE && wclass.strings ?
+                wclass.strings : "");
 
         if (wclass.strings) {
             xcb_ewmh_get_utf8_strings_reply_wipe(&wclass);
         }
 
         fflush(stdout);
-        if (cd != d - 1)
-            select_desktop(cd);
     }
-#ifdef EWMH_TASKBAR
-    Update_EWMH_Taskbar_Properties();
-#endif
+    if (SHM_STATE)
+        Update_Shm_State();
+
+    /* kept up to date without subscribers, so the first one gets no stale news */
+    xcb_window_t focus = M_CURRENT ? M_CURRENT->win : XCB_WINDOW_NONE;
+
+    if (lastdesktop != current_desktop_number)
+        Emit_IPC_Event(IPC_EV_DESKTOP, current_desktop_number, 0);
+    if (lastdesktop != current_desktop_number || lastmode != M_MODE)
+        Emit_IPC_Event(IPC_EV_MODE, current_desktop_number, M_MODE);
+    if (lastfocus != focus)
+        Emit_IPC_Event(IPC_EV_FOCUS, focus, 0);
+    /* the last request of a switch, its notify tells it is done */
+    if (lastdesktop != current_desktop_number)
+        xcb_ewmh_set_current_desktop(ewmh, default_screen, current_desktop_number);
+    lastfocus = focus;
+    lastdesktop = current_desktop_number;
+    lastmode = M_MODE;
+}
+
+/*
+ * mark the desktop info stale, run() outputs it once the event is handled.
+ * reading the title waits for the X server, which must not happen in the
+ * middle of a desktop switch or layout.
+ */
+void desktopinfo(void)
+{
+    desktopinfo_stale = true;
 }
 
 static void destroy_display(client *c)
@@ -1427,26 +2097,32 @@ static void destroy_display(client *c)
     /* relink entire clientlist to the tail of next display clientlist. */
         add_tail(&next->clients, &t->link);
     }
-    for (lifo *t = (lifo *)rem_head(&disp->miniq); t; t = (lifo *)rem_head(&disp->miniq)) {
-    /* relink minimized clients to the tail of next display clientlist. */
-        xcb_move(dis, t->c->win, t->c->position_info.previous_x,
-                                 t->c->position_info.previous_y, NULL);
-        t->c->position_info.previous_x = t->c->position_info.current_x;
-        t->c->position_info.previous_y = t->c->position_info.current_y;
-        add_tail(&next->clients, &t->c->link);
-        t->c->isminimized = False;
-        xcb_remove_property(dis, t->c->win, ewmh->_NET_WM_STATE, ewmh->_NET_WM_STATE_HIDDEN);
-        free(t);
-
+    for (node *n = rem_head(&disp->miniq); n; n = rem_head(&disp->miniq)) {
+    /* restore minimized clients, they already moved with the clientlist. */
+        client *t = MINI_CLIENT(n);
+        if (!UNMAP_HIDDEN) {
+            xcb_move(dis, t->win, t->position_info.previous_x,
+                                  t->position_info.previous_y, NULL);
+            t->position_info.previous_x = t->position_info.current_x;
+            t->position_info.previous_y = t->position_info.current_y;
+        }
+        t->isminimized = False;
+        client_changed(t);
     }
     rem_node(&disp->link);                   /* unlink now empty display */
     select_desktop(current_desktop_number);     /* update global pointers */
     for (alien *t = (alien *)get_head(&aliens); t; t = (alien *)get_next(&t->link))   /* show aliens */
         xcb_move(dis, t->win, t->position_info.previous_x, t->position_info.previous_y, &t->position_info);
     if (current_display == next) {
+        if (UNMAP_HIDDEN && current_desktop_number == shown_desktop)
+            for (client *t = M_HEAD; t; t = M_GETNEXT(t))
+                show_client(t);     /* the windows create_display() hid */
         update_current(c);
     }
-    free(disp);
+    free(disp->tiled);
+    free(disp->borders);
+    free(disp->rects);
+    pool_free(&displaypool, disp);
 }
 
 /*
@@ -1457,6 +2133,7 @@ void destroynotify(xcb_generic_event_t *e)
 {
     xcb_destroy_notify_event_t *ev = (xcb_destroy_notify_event_t *)e;
     client *c = wintoclient(ev->window);
+    int n;
 
     DEBUG("xcb: destroy notify");
 
@@ -1465,10 +2142,20 @@ void destroynotify(xcb_generic_event_t *e)
             destroy_display(c);
         removeclient(c);
     }
-    else if (USE_SCRATCHPAD && scrpd && ev->window == scrpd->win) {
-        free(scrpd);
-        scrpd = NULL;
-        update_current(M_CURRENT);
+    else if (USE_SCRATCHPAD && (n = find_scratchpad(ev->window)) >= 0) {
+        client *s = scrpds[n];
+#ifdef EWMH_TASKBAR
+        Remove_EWMH_Client(s->win);
+#endif /* EWMH_TASKBAR */
+        scrpds[n] = NULL;
+        if (scrpd == s) {
+            scrpd = NULL;
+            showscratchpad = false;
+        }
+        update_current(M_CURRENT == s ? NULL : M_CURRENT);
+        pool_free(&clientpool, s);
+        if (running && now_ms() - scrpdstarted[n] >= SCRPDRESPAWN * 1000L)
+            spawn_scratchpad(n);    /* have it ready for the next toggle */
     }
    else {
         alien *a;
@@ -1476,89 +2163,13 @@ void destroynotify(xcb_generic_event_t *e)
         if((a = wintoalien(&aliens, ev->window))) {
             DEBUG("unlink selfmapped window");
             rem_node(&a->link);
-            free(a);
+            dock_changed(a);
+            pool_free(&alienpool, a);
         }
     }
     desktopinfo();
 }
 
-/* dualstack layout (three-column-layout, tcl in dwm) */
-void dualstack(int hh, int cy)
-{
-    client *c = NULL, *t = NULL;
-    int n = 0, z = hh, d = 0, l = 0, r = 0, cb = cy,
-        ma = (M_INVERT ? M_WH : M_WW) * MASTER_SIZE + M_MASTER_SIZE;
-
-    /* count stack windows and grab first non-floating, non-maximize window */
-    for (t = M_HEAD; t; t = M_GETNEXT(t)) {
-        if (!ISFMFTM(t)) {
-            if (c)
-                ++n;
-            else
-                c = t;
-        }
-    }
-
-    l = (n - 1) / 2 + 1; /* left stack size */
-    r = n - l;          /* right stack size */
-
-    if (!c) {
-        return;
-    } else if (!n) {
-        int borders = client_borders(c);
-        xcb_move_resize(dis, c->win, M_GAPS, cy + M_GAPS,
-                        M_WW - 2 * (borders + M_GAPS),
-                        hh - 2 * (borders + M_GAPS), &c->position_info);
-        return;
-    }
-
-    /* tile the first non-floating, non-maximize window to cover the master area */
-    int borders = client_borders(c);
-    if (current_display->di.invert)
-        xcb_move_resize(dis, c->win, M_GAPS,
-                        cy + (hh - ma) / 2 + M_GAPS,
-                        M_WW - 2 * (borders + M_GAPS),
-                        n > 1 ? ma - 2 * M_GAPS - 2 * borders
-                              : ma + (hh - ma) / 2 - 2 * borders - 2 * M_GAPS, &c->position_info);
-    else
-        xcb_move_resize(dis, c->win, (M_WW - ma) / 2 + borders + M_GAPS,
-                        cy + M_GAPS,
-                        n > 1 ? (ma - 4 * borders - 2 * M_GAPS)
-                              : (ma + (M_WW - ma) / 2 - 3 * borders - 2 * M_GAPS),
-                        hh - 2 * (borders + M_GAPS), &c->position_info);
-
-    int cx = M_GAPS,
-        cw = (M_WW - ma) / 2 - borders - M_GAPS,
-        ch = z;
-        cy += M_GAPS;
-
-    /* tile the non-floating, non-maximize stack windows */
-    for (c = M_GETNEXT(c); c; c = M_GETNEXT(c)) {
-        for (d = 0, t = M_HEAD; t != c; t = M_GETNEXT(t), d++);
-        if (ISFMFTM(c))
-            continue;
-        int borders = client_borders(c);
-        if (M_INVERT) {
-            if (d == l + 1) /* we are on the -right- bottom stack, reset cy */
-                cx = M_GAPS;
-            if (d > 1 && d != l + 1)
-                cx += (M_WW - M_GAPS) / (d <= l ? l : r);
-            xcb_move_resize(dis, c->win,
-                        cx, (d <= l) ? cy : cy + (hh - ma) / 2 + ma - M_GAPS,
-                        (M_WW - M_GAPS) / (d <= l ? l : r) - 2 * borders - M_GAPS,
-                        (hh - ma) / 2 - 2 * borders - M_GAPS, &c->position_info);
-        } else {
-            if (d == l + 1) /* we are on the right stack, reset cy */
-                cy = cb + M_GAPS;
-            if (d > 1 && d != l + 1)
-                cy += (ch - M_GAPS) / (d <= l ? l : r);
-            xcb_move_resize(dis, c->win,
-                        d <= l ? cx : M_WW - cw - 2 * borders - M_GAPS, cy, cw,
-                        (ch - M_GAPS) / (d <= l ? l : r) - 2 * borders - M_GAPS, &c->position_info);
-        }
-    }
-}
-
 /*
  * when the mouse enters a window's borders
  * the window, if notifying of such events (EnterWindowMask)
@@ -1590,96 +2201,6 @@ void enternotify(xcb_generic_event_t *e)
     }
 }
 
-/*
- * equal mode
- * tile the windows in rows or columns, givin each window an equal amount of
- * screen space
- * will use rows when inverted and columns otherwise
- */
-void equal(int h, int y)
-{
-    int n = 0, j = -1;
-
-    for (client *c = M_HEAD; c; c = M_GETNEXT(c)) {
-        if (ISFMFTM(c))
-            continue;
-        n++;
-    }
-
-    for (client *c = M_HEAD; c; c = M_GETNEXT(c)) {
-        int borders = client_borders(c);
-        if (ISFMFTM(c))
-            continue;
-        else
-            j++;
-        if (M_INVERT)
-            xcb_move_resize(dis, c->win, M_GAPS,
-                            y + h / n * j + (c == M_HEAD ? M_GAPS : 0),
-                            M_WW - 2 * borders - 2 * M_GAPS,
-                            h / n - 2 * borders - (c == M_HEAD ? 2 : 1) * M_GAPS, &c->position_info);
-        else
-            xcb_move_resize(dis, c->win, M_WW / n * j + (c == M_HEAD ? M_GAPS : 0),
-                            y + M_GAPS,
-                            M_WW / n - 2 * borders - (c == M_HEAD ? 2 : 1) * M_GAPS,
-                            h - 2 * borders - 2 * M_GAPS, &c->position_info);
-    }
-}
-
-/*
- * fibonacci mode / fibonacci layout
- * tile the windows based on the fibonacci series pattern.
- * arrange windows in such a way that every new window shares
- * half the space of the space taken by the last window
- * inverting changes between right/down and right/up
- */
-void fibonacci(int h, int y)
-{
-    int borders = borders;
-    if (M_HEAD)
-        borders = client_borders(M_HEAD);
-
-    int j = -1, x = M_GAPS, tt = 0,
-        cw = M_WW - 2 * M_GAPS - 2 * borders,
-        ch = h - 2 * M_GAPS - 2 * borders;
-
-    for (client *n, *c = M_HEAD; c; c = M_GETNEXT(c)) {
-        int borders = client_borders(c);
-        if (ISFMFTM(c))
-            continue;
-        else
-            j++;
-        for (n = M_GETNEXT(c); n; n = M_GETNEXT(n))
-            if (!ISFMFTM(n))
-                break;
-
-        /*
-         * not the last window in stack ? -> half the client size, and also
-         * check if we have too many windows to keep them larger than MINWSZ
-         */
-        if (n
-            && ch > MINWSZ * 2 + borders + M_GAPS
-            && cw > MINWSZ * 2 + borders + M_GAPS) {
-            (j & 1) ? (ch = ch / 2 - borders - M_GAPS / 2)
-                    : (cw = cw / 2 - borders - M_GAPS / 2);
-            tt = j;
-        }
-
-        /* not the master client ? -> shift client right or down (or up) */
-        if (j) {
-            (j & 1) ? (x = x + cw + 2 * borders + M_GAPS)
-                    : (y = M_INVERT ? (y - ch - 2 * borders - M_GAPS)
-                                    : (y + ch + 2 * borders + M_GAPS));
-
-            if (j & 1 && n && M_INVERT)
-                y += ch + 2 * borders + M_GAPS;
-        }
-
-        /* if the window does not fit in the stack, do not jam it in there */
-        if (j <= tt + 1)
-            xcb_move_resize(dis, c->win, x, y + M_GAPS, cw, ch, &c->position_info);
-    }
-}
-
 /* switch a client from tiling to float and manage everything involved */
 void float_client(client *c)
 {
@@ -1687,6 +2208,7 @@ void float_client(client *c)
         return;
 
     c->isfloating = true;
+    client_changed(c);
 
     if (c->dim[0] && c->dim[1]) {
         if (c->dim[0] < MINWSZ)
@@ -1767,24 +2289,31 @@ void focusmaster()
  * the urgent hint in the current desktop */
 void focusurgent()
 {
-    client *c;
-    int cd = current_desktop_number, d = 0;
+    client *c = NULL;
+    desktop *cdesk = NULL;
 
-    for (c = M_HEAD; c && !c->isurgent; c = M_GETNEXT(c));
-    if (c) {
-        update_current(c);
-        return;
-    } else {
-        for (bool f = false; d < DESKTOPS && !f; d++) {
-            for (select_desktop(d), c = M_HEAD; c && !(f = c->isurgent); c = M_GETNEXT(c))
-                ;
+    /* the oldest urgent client, preferring the current desktop */
+    for (node *n = get_head(&urgents); n; n = get_next(n)) {
+        client *t = URGENT_CLIENT(n);
+        display *disp;
+        desktop *desk;
+
+        getparents(t, &disp, NULL, &desk);
+        if (disp != (desk == current_desktop ? current_display
+                     : (display *)get_head(&((monitor *)get_head(&desk->monitors))->displays)))
+            continue;   /* not on the display the desktop shows */
+        if (!c || desk == current_desktop) {
+            c = t;
+            cdesk = desk;
         }
+        if (desk == current_desktop || !current_desktop->nurgent)
+            break;
     }
-    select_desktop(cd);
-    if (c) {
-        change_desktop(&(Arg){.i = --d});
-        update_current(c);
-    }
+    if (!c)
+        return;
+    if (cdesk != current_desktop)
+        change_desktop(&(Arg){.i = cdesk->num});
+    update_current(c);
 }
 
 /* get a pixel with the requested color
@@ -1842,7 +2371,7 @@ void grabbuttons(client *c)
         xcb_grab_button(dis, 1, c->win, XCB_EVENT_MASK_BUTTON_PRESS,
                         XCB_GRAB_MODE_SYNC, XCB_GRAB_MODE_ASYNC,
                         XCB_WINDOW_NONE, XCB_CURSOR_NONE,
-                        (c == scrpd) ? XCB_BUTTON_INDEX_1 : XCB_BUTTON_INDEX_ANY,
+                        find_scratchpad(c->win) >= 0 ? XCB_BUTTON_INDEX_1 : XCB_BUTTON_INDEX_ANY,
                         XCB_BUTTON_MASK_ANY);
     else {
         unsigned int modifiers[] = { 0, XCB_MOD_MASK_LOCK, numlockmask,
@@ -1880,44 +2409,6 @@ void grabkeys(void)
     }
 }
 
-/* arrange windows in a grid */
-void grid(int hh, int cy)
-{
-    int n = 0, cols = 0, cn = 0, rn = 0, i = -1;
-
-    for (client *c = M_HEAD; c; c = M_GETNEXT(c))
-        if (!ISFMFTM(c))
-            ++n;
-    if (!n)
-        return;
-    for (cols = 0; cols <= n / 2; cols++)
-        if (cols * cols >= n)
-            break; /* emulate square root */
-    if (n == 5)
-        cols = 2;
-
-    int rows = n / cols,
-        ch = hh - M_GAPS,
-        cw = (M_WW - M_GAPS) / (cols ? cols : 1);
-    for (client *c = M_HEAD; c; c = M_GETNEXT(c)) {
-        int borders = client_borders(c);
-        if (ISFMFTM(c))
-            continue;
-        else
-            ++i;
-        if (i / rows + 1 > cols - n % cols)
-            rows = n / cols + 1;
-        xcb_move_resize(dis, c->win, cn * cw + M_GAPS,
-                        cy + rn * ch / rows + M_GAPS,
-                        cw - 2 * borders - M_GAPS,
-                        ch / rows - 2 * borders - M_GAPS, &c->position_info);
-        if (++rn >= rows) {
-            rn = 0;
-            cn++;
-        }
-    }
-}
-
 /* invert v-stack left-right */
 void invertstack()
 {
@@ -1984,7 +2475,7 @@ void mapnotify(xcb_generic_event_t *e)
 
     DEBUG("xcb: map notify");
 
-    if (wintoclient(ev->window) || (scrpd && scrpd->win == ev->window))
+    if (wintoclient(ev->window) || find_scratchpad(ev->window) >= 0)
         return;
 
     xcb_window_t wins[] = {ev->window};
@@ -2032,7 +2523,6 @@ void maprequest(xcb_generic_event_t *e)
 {
     xcb_map_request_event_t            *ev = (xcb_map_request_event_t *)e;
     xcb_window_t                       transient = 0;
-    xcb_get_property_reply_t           *prop_reply;
     xcb_icccm_get_wm_class_reply_t     wclass;
     xcb_atom_t                         wtype = ewmh->_NET_WM_WINDOW_TYPE_NORMAL;
     client *c;
@@ -2042,9 +2532,13 @@ void maprequest(xcb_generic_event_t *e)
 
     if ((c = wintoclient(ev->window))) {
         if (!find_client(c->win)) {     /* client is on different display */
+            desktop *desk;
+            getparents(c, NULL, NULL, &desk);
             rem_node(&c->link);
             add_tail(&current_display->clients, &c->link);
+            client_moved(c, desk);
         }
+        c->ishidden = false;
         xcb_map_window(dis, c->win);
         update_current(c);
         return;
@@ -2053,30 +2547,25 @@ void maprequest(xcb_generic_event_t *e)
     if (check_if_window_is_alien(ev->window, &isFloating, &wtype))
         return;
 
-    xcb_remove_property(dis, ev->window, ewmh->_NET_WM_STATE, ewmh->_NET_WM_STATE_HIDDEN);
-
     DEBUG("event is valid");
 
     bool follow = false;
-    int cd = current_desktop_number, newdsk = current_desktop_number, border_width = -1;
+    int cd = current_desktop_number, newdsk = current_desktop_number, newmon = -1, border_width = -1;
+    bool suspend = false;
 
     if (xcb_icccm_get_wm_class_reply(dis, xcb_icccm_get_wm_class_unchecked(dis, ev->window), &wclass, NULL)) {
         char *instance_name = wclass.instance_name;
         char *class_name = wclass.class_name;
         DEBUGP("class,inst: %s,%s\n", class_name, instance_name);
 
-        if (!strcmp(instance_name, SCRPDNAME)) {
-            scrpd = create_client(ev->window, wtype);
-            setwindefattr(scrpd->win);
-            grabbuttons(scrpd);
-
-            xcb_move(dis, scrpd->win, -2 * M_WW, 0, &scrpd->position_info);
-            xcb_map_window(dis, scrpd->win);
+        for (unsigned int i = 0; USE_SCRATCHPAD && i < LENGTH(scratchpads); i++) {
+            if (scrpds[i] || strcmp(instance_name, scratchpads[i].name))
+                continue;
+            adopt_scratchpad(i, ev->window, wtype);
+            xcb_map_window(dis, ev->window);
             xcb_icccm_get_wm_class_reply_wipe(&wclass);
-
-            if (scrpd_atom)
-                xcb_change_property(dis, XCB_PROP_MODE_REPLACE, scrpd->win, scrpd_atom,
-                                    XCB_ATOM_WINDOW, 32, 1, &scrpd->win);
+            if (scrpdpending == (int)i)
+                togglescratchpad(&(Arg){.i = i});
             return;
         }
 
@@ -2089,6 +2578,8 @@ void maprequest(xcb_generic_event_t *e)
                                                         : rules[i].desktop;
                 isFloating = rules[i].floating;
                 border_width = rules[i].border_width;
+                newmon = rules[i].monitor;
+                suspend = rules[i].suspend;
                 break;
             }
 
@@ -2097,6 +2588,8 @@ void maprequest(xcb_generic_event_t *e)
 
     if (cd != newdsk)
         select_desktop(newdsk);
+    monitor *moni = newmon >= 0 ? find_monitor(newmon) : NULL;
+    select_monitor(moni ? moni : pointer_monitor());
     c = addwindow(ev->window, wtype);
 
     xcb_icccm_get_wm_transient_for_reply(dis,
@@ -2104,54 +2597,51 @@ void maprequest(xcb_generic_event_t *e)
                     &transient, NULL); /* TODO: error handling */
     c->istransient = transient ? true : false;
     c->isfloating  = isFloating || c->istransient;
+    client_changed(c);
     c->borderwidth = border_width;
+    c->suspend = suspend;
+    suspend_stale = suspending;
 
-    prop_reply = xcb_get_property_reply(dis, xcb_get_property_unchecked(
-                                    dis, 0, ev->window, ewmh->_NET_WM_STATE,
-                                    XCB_ATOM_ATOM, 0, 1), NULL);
-                                    /* TODO: error handling */
-    if (prop_reply) {
-        if (prop_reply->format == 32) {
-            xcb_atom_t *v = xcb_get_property_value(prop_reply);
-            for (unsigned int i = 0; i < prop_reply->value_len; i++) {
-                DEBUGP("%d : %d\n", i, v[i]);
-                if (v[i] == ewmh->_NET_WM_STATE_FULLSCREEN)
-                    setfullscreen(c, True);
-            }
-        }
-        free(prop_reply);
-    }
+    if (c->netfullscreen)   /* asked for before it was mapped */
+        setfullscreen(c, True);
 
     DEBUGP("transient: %d\n", c->istransient);
     DEBUGP("floating:  %d\n", c->isfloating);
 
     int wmdsk = cd;
-    bool visible = True;
-    xcb_move(dis, c->win, -2 * M_WW, 0, &c->position_info);
-    xcb_map_window(dis, c->win);
+    bool visible = show, arranged = false, focus = false;
     if (cd != newdsk) {
-        visible = False;
-        rem_node(&c->link);
-        select_desktop(newdsk);
+        rem_node(&c->link);     /* the end of the stack, until it is shown */
         add_tail(&current_display->clients, &c->link);
         select_desktop(cd);
         wmdsk = newdsk;
-        if (follow) {
-            visible = True;
-            change_desktop(&(Arg){.i = newdsk});
-        }
+        if (follow) {           /* arranged with the desktop, focused once mapped */
+            focus = show_desktop(newdsk, c);
+            arranged = true;
+        } else
+            visible = False;
     }
-    if (visible && show) {
-        xcb_move(dis, c->win, c->position_info.previous_x,
-                              c->position_info.previous_y, NULL);
-        c->position_info.previous_x = c->position_info.current_x;
-        c->position_info.previous_y = c->position_info.current_y;
-        update_current(c);
+    xcb_ewmh_set_wm_desktop(ewmh, c->win, wmdsk);
+    grabbuttons(c);
+    if (visible) {
+        /*
+         * lay out, center and frame the window while it is still unmapped,
+         * so the first frame it paints is already at its final geometry
+         */
+        if (!arranged)
+            focus = arrange_current(c);
         if (c->isfloating && AUTOCENTER)
             centerfloating(c);
+        xcb_map_window(dis, c->win);
+        if (focus)
+            focus_current();
+    } else if (UNMAP_HIDDEN) {
+        c->ishidden = true;     /* show_client() maps it */
+        set_wm_state(c->win, XCB_ICCCM_WM_STATE_ICONIC);
+    } else {
+        xcb_move(dis, c->win, -2 * M_WW, 0, &c->position_info);
+        xcb_map_window(dis, c->win);
     }
-    xcb_ewmh_set_wm_desktop(ewmh, c->win, wmdsk);
-    grabbuttons(c);
     desktopinfo();
 }
 
@@ -2164,24 +2654,18 @@ void maximize()
     setmaximize(M_CURRENT, !M_CURRENT->ismaximized);
 }
 
-/* push the current client down the miniq and minimize the window */
+/* push the client down its display's miniq and minimize the window */
 void minimize_client(client *c)
 {
-    lifo *new;
-
-    if (!c || c->isfullscreen)
-        return;
-
-    new = calloc(1, sizeof(lifo));
-    if (!new)
+    if (!c || c->isfullscreen || c->isminimized)
         return;
 
-    new->c = c;
-    add_head(&current_display->miniq, &new->link);
+    add_head(&((display *)c->link.parent->master)->miniq, &c->minilink);
 
-    new->c->isminimized = true;
-    xcb_move(dis, new->c->win, -2 * M_WW, 0, &new->c->position_info);
-    xcb_add_property(dis, new->c->win, ewmh->_NET_WM_STATE, ewmh->_NET_WM_STATE_HIDDEN);
+    c->isminimized = true;
+    client_changed(c);
+    hide_client(c);
+    visibility_stale = true;
 
     client *t = M_HEAD;
     while (t) {
@@ -2287,17 +2771,6 @@ void mousemotion(const Arg *arg)
     free(pointer);
 }
 
-/* each window should cover all the available screen space */
-void monocle(int hh, int cy)
-{
-    unsigned int b = MONOCLE_BORDERS ? 2 * client_borders(M_CURRENT) : 0;
-
-    for (client *c = M_HEAD; c; c = M_GETNEXT(c))
-        if (!ISFMFTM(c))
-            xcb_move_resize(dis, c->win, M_GAPS, cy + M_GAPS,
-                            M_WW - 2 * M_GAPS - b, hh - 2 * M_GAPS - b, &c->position_info);
-}
-
 /* move the current client, to current->next
 * and current->next to current client's position */
 void move_down()
@@ -2386,6 +2859,7 @@ void propertynotify(xcb_generic_event_t *e)
 #ifdef EWMH_TASKBAR
     if (ev->atom == ewmh->_NET_WM_STRUT
      || ev->atom == ewmh->_NET_WM_STRUT_PARTIAL) {
+        Invalidate_Global_Strut();
         tile();
         return;
     }
@@ -2394,11 +2868,42 @@ void propertynotify(xcb_generic_event_t *e)
     c = wintoclient(ev->window);
     if (!c)
         return;
-    else if (xcb_icccm_get_wm_hints_reply(dis,
+
+    if (ev->atom == ewmh->_NET_WM_STATE) {
+        if (c->netwrites)
+            c->netwrites--;     /* our own write */
+        else {
+            read_net_wm_state(c);
+            visibility_stale = true;    /* puts our atoms back */
+        }
+        return;
+    }
+
+    if (ev->atom == XCB_ATOM_WM_NORMAL_HINTS) {
+        update_size_hints(c);
+        if (SIZE_HINTS && c->istiled) {
+            display *disp = c->link.parent->master;
+            disp->needslayout = true;
+            tile_display(disp);     /* the client's own monitor */
+        }
+        return;
+    }
+
+    /* only the focused window's title is of interest */
+    if (ev->atom == ewmh->_NET_WM_NAME || ev->atom == XCB_ATOM_WM_NAME) {
+        if (c == M_CURRENT) {
+            shmtitlewin = XCB_WINDOW_NONE;
+            desktopinfo();
+        }
+        return;
+    }
+
+    if (xcb_icccm_get_wm_hints_reply(dis,
                                           xcb_icccm_get_wm_hints(dis, ev->window),
-                                          &wmh, NULL))
+                                          &wmh, NULL)) {
                                           /* TODO: error handling */
-        c->isurgent = xcb_icccm_wm_hints_get_urgency(&wmh);
+        set_urgent(c, xcb_icccm_wm_hints_get_urgency(&wmh));
+    }
     else if (ev->atom != XCB_ICCCM_WM_ALL_HINTS)
         return;
 
@@ -2424,20 +2929,36 @@ void quit(const Arg *arg)
 void removeclient(client *c)
 {
     int nd = 0, cd = current_desktop_number;
+    desktop *desk;
 
     if (!c)
         return;
+    getparents(c, NULL, NULL, &desk);
+    if (c->isurgent)
+        desk->nurgent--;
     rem_node(&c->link);
+    rem_node(&c->minilink);
+    rem_node(&c->urgentlink);
+    update_occupancy(desk);
+    if (c->isstopped) {     /* its other windows, if any, decide again */
+        kill(c->pid, SIGCONT);
+        suspend_stale = true;
+    }
+#ifdef EWMH_TASKBAR
+    Remove_EWMH_Client(c->win);
+#endif /* EWMH_TASKBAR */
+    Emit_IPC_Event(IPC_EV_UNMANAGE, c->win, 0);
     if (c == M_PREVFOCUS)
         M_PREVFOCUS = M_GETPREV(M_CURRENT);
     if (c == M_CURRENT || !M_GETNEXT(M_HEAD))
         update_current(M_PREVFOCUS);
-    free(c);
+    pool_free(&clientpool, c);
     c = NULL;
     if (cd == nd - 1)
         tile();
     else
         select_desktop(cd);
+    reclaim_desktop(desk);
 }
 
 /* resize the master window - check for boundary size limits
@@ -2508,25 +3029,22 @@ void resize_y(const Arg *arg)
     free(r);
 }
 
-/* get (the last) client from the current miniq and restore it */
+/* get the given (or the last) client from the current miniq and restore it */
 void restore_client(client *c)
 {
-    lifo *t;
-
-    if (!check_head(&current_display->miniq))
-        return;
-
-    if (c == NULL)
-        t = (lifo *)get_head(&current_display->miniq);
-    else
-        for (t = (lifo *)get_head(&current_display->miniq); t && t->c != c; t = (lifo *)get_next(&t->link)) ;
-    if (!t)
+    if (c == NULL) {
+        if (!check_head(&current_display->miniq))
+            return;
+        c = MINI_CLIENT(get_head(&current_display->miniq));
+    }
+    else if (!c->isminimized || c->minilink.parent != &current_display->miniq)
         return;
-    else
-        rem_node(&t->link);
+    rem_node(&c->minilink);
 
-    t->c->isminimized = false;
-    xcb_remove_property(dis, t->c->win, ewmh->_NET_WM_STATE, ewmh->_NET_WM_STATE_HIDDEN);
+    c->isminimized = false;
+    client_changed(c);
+    if (UNMAP_HIDDEN)
+        show_client(c);
 
     /*
      * if our window is floating, center it to move it back onto the visible
@@ -2534,26 +3052,79 @@ void restore_client(client *c)
      * before minimizing, TODO: fix it to use centerwindow() instead of copying
      * half of it
      */
-    if (t->c->isfloating)
-        centerfloating(t->c);
+    if (c->isfloating)
+        centerfloating(c);
     tile();
-    update_current(t->c);
-    free(t);
+    update_current(c);
 }
 
 /* return true if desktop has clients */
 bool desktop_populated(desktop *d)
 {
-    monitor *moni;
-    for (moni = (monitor *)get_head(&d->monitors); moni; moni = (monitor *)get_next(&moni->link)) {
-        display *disp;
-        for (disp = (display *)get_head(&moni->displays); disp; disp = (display *)get_next(&disp->link)) {
-            if(get_head(&disp->clients)) {
-                return true;
+    return occupied[d->num / OCC_BITS] & (1UL << d->num % OCC_BITS);
+}
+
+/* first populated desktop in [lo, hi), -1 if there is none */
+static int populated_after(int lo, int hi)
+{
+    for (int i = lo; i < hi;) {
+        unsigned long w = occupied[i / OCC_BITS] >> (i % OCC_BITS);
+        if (w) {
+            i += __builtin_ctzl(w);
+            return (i < hi) ? i : -1;
+        }
+        i = (i / OCC_BITS + 1) * OCC_BITS;
+    }
+    return -1;
+}
+
+/* last populated desktop in [lo, hi), -1 if there is none */
+static int populated_before(int lo, int hi)
+{
+    for (int i = hi - 1; i >= lo;) {
+        unsigned long w = occupied[i / OCC_BITS] << (OCC_BITS - 1 - i % OCC_BITS);
+        if (w) {
+            i -= __builtin_clzl(w);
+            return (i >= lo) ? i : -1;
+        }
+        i = (i / OCC_BITS) * OCC_BITS - 1;
+    }
+    return -1;
+}
+
+/*
+ * recheck whether any display of the desktop has clients and update its bit
+ * in the occupancy bitmap. call after clients left or joined the desktop.
+ */
+static void update_occupancy(desktop *d)
+{
+    for (monitor *moni = (monitor *)get_head(&d->monitors); moni; moni = (monitor *)get_next(&moni->link)) {
+        for (display *disp = (display *)get_head(&moni->displays); disp; disp = (display *)get_next(&disp->link)) {
+            if (get_head(&disp->clients)) {
+                occupied[d->num / OCC_BITS] |= 1UL << d->num % OCC_BITS;
+                return;
             }
         }
     }
-    return false;
+    occupied[d->num / OCC_BITS] &= ~(1UL << d->num % OCC_BITS);
+}
+
+/* c was moved away from desktop from, update the bookkeeping of both desktops */
+static void client_moved(client *c, desktop *from)
+{
+    desktop *to;
+
+    getparents(c, NULL, NULL, &to);
+    if (to == from)
+        return;
+    suspend_stale = suspending;
+    if (c->isurgent) {
+        from->nurgent--;
+        to->nurgent++;
+    }
+    update_occupancy(from);
+    update_occupancy(to);
+    reclaim_desktop(from);
 }
 
 /* restore_client(); wrapper */
@@ -2582,31 +3153,19 @@ void rotate_client(const Arg *arg)
 /* jump and focus the next or previous desktop that has clients */
 void rotate_filled(const Arg *arg)
 {
-    desktop *newdesk;
+    int cd = current_desktop_number, d;
 
     if (arg->i > 0) {   /* forward */
-        for (newdesk = (desktop *)get_next(&current_desktop->link);;) {
-            if (!newdesk) {
-                newdesk = (desktop *)get_head(&desktops);
-            } else {
-                if (newdesk == current_desktop || desktop_populated(newdesk)) break;
-                newdesk = (desktop *)get_next(&newdesk->link);
-            }
-        }
+        if ((d = populated_after(cd + 1, DESKTOPS)) < 0)
+            d = populated_after(0, cd);
     }
     else {
-        for (newdesk = (desktop *)get_prev(&current_desktop->link);;) {
-            if (!newdesk) {
-                newdesk = (desktop *)get_tail(&desktops);
-            } else {
-                if (newdesk == current_desktop || desktop_populated(newdesk)) break;
-                newdesk = (desktop *)get_prev(&newdesk->link);
-            }
-        }
+        if ((d = populated_before(0, cd)) < 0)
+            d = populated_before(cd + 1, DESKTOPS);
     }
 
-    if (newdesk)
-        change_desktop(&(Arg){.i = newdesk->num});
+    if (d >= 0)
+        change_desktop(&(Arg){.i = d});
 }
 
 /*
@@ -2652,10 +3211,34 @@ void run(void)
     xcb_generic_event_t *ev;
 
     while(running) {
+        if (visibility_stale)
+            update_visibility();
+        if (suspend_stale || (suspend_deadline && now_ms() >= suspend_deadline))
+            update_suspended();
+        if (desktopinfo_stale) {
+            desktopinfo_stale = false;
+            update_desktopinfo();
+        }
         xcb_flush(dis);
         if (xcb_connection_has_error(dis))
             err(EXIT_FAILURE, "error: X11 connection got interrupted\n");
-        if ((ev = xcb_wait_for_event(dis))) {
+        if (!(ev = xcb_poll_for_event(dis))) {
+            int timeout = -1;   /* until the next process is to be stopped */
+            if (suspend_deadline) {
+                long due = suspend_deadline - now_ms();
+                timeout = due > 0 ? due : 0;
+            }
+            if (ipcfd >= 0) {
+                Wait_IPC(timeout);  /* sleep until X or the IPC socket have news */
+                continue;
+            }
+            if (timeout >= 0) {
+                poll(&(struct pollfd){ .fd = xcb_get_file_descriptor(dis), .events = POLLIN }, 1, timeout);
+                continue;
+            }
+            ev = xcb_wait_for_event(dis);
+        }
+        if (ev) {
             if (events[ev->response_type & ~0x80]) {
                 events[ev->response_type & ~0x80](ev);
             } else {
@@ -2666,6 +3249,178 @@ void run(void)
     }
 }
 
+/*
+ * pair the outputs from before a change with the ones after it: the same
+ * CRTC, else the same rectangle, else the one it overlaps most. map[o] is
+ * the new index of old output o, -1 when it is gone.
+ */
+static void match_heads(const xcb_rectangle_t *old, const xcb_randr_crtc_t *oldcrtcs, int nold, int *map)
+{
+    bool taken[nheads];
+
+    memset(taken, 0, sizeof(taken));
+    for (int o = 0; o < nold; o++)
+        map[o] = -1;
+    for (int pass = 0; pass < 3; pass++)
+        for (int o = 0; o < nold; o++) {
+            const xcb_rectangle_t *a = &old[o];
+            long most = 0;
+            int best = -1;
+            if (map[o] >= 0)
+                continue;
+            for (int h = 0; h < nheads; h++) {
+                const xcb_rectangle_t *b = &heads[h];
+                if (taken[h])
+                    continue;
+                if (pass == 0 && oldcrtcs[o] && oldcrtcs[o] == headcrtcs[h]) {
+                    best = h;
+                    break;
+                }
+                if (pass == 1 && a->x == b->x && a->y == b->y
+                    && a->width == b->width && a->height == b->height) {
+                    best = h;
+                    break;
+                }
+                if (pass == 2) {
+                    long w = (a->x + a->width < b->x + b->width ? a->x + a->width : b->x + b->width)
+                             - (a->x > b->x ? a->x : b->x);
+                    long ht = (a->y + a->height < b->y + b->height ? a->y + a->height : b->y + b->height)
+                              - (a->y > b->y ? a->y : b->y);
+                    if (w > 0 && ht > 0 && w * ht > most) {
+                        most = w * ht;
+                        best = h;
+                    }
+                }
+            }
+            if (best >= 0) {
+                map[o] = best;
+                taken[best] = true;
+            }
+        }
+}
+
+/* the monitor of desk, other than those in skip, whose output is nearest to r */
+static monitor *nearest_monitor(desktop *desk, const xcb_rectangle_t *r, monitor **skip, int nskip)
+{
+    monitor *near = NULL;
+    long best = 0;
+
+    for (monitor *m = (monitor *)get_head(&desk->monitors); m; m = (monitor *)get_next(&m->link)) {
+        int s;
+        for (s = 0; s < nskip && skip[s] != m; s++) ;
+        if (s < nskip)
+            continue;
+        const xcb_rectangle_t *h = &heads[m->num];
+        long dx = (h->x + h->width / 2) - (r->x + r->width / 2),
+             dy = (h->y + h->height / 2) - (r->y + r->height / 2);
+        if (!near || dx * dx + dy * dy < best) {
+            near = m;
+            best = dx * dx + dy * dy;
+        }
+    }
+    return near;
+}
+
+/*
+ * an output was plugged in or out, or changed its resolution or rotation.
+ * monitors follow their output by CRTC, or by its place on the screen. a
+ * monitor whose output is gone hands its clients to the one nearest to it
+ * and new outputs get a monitor on every desktop. only displays whose
+ * geometry changed are laid out again, on hidden desktops once they are
+ * shown.
+ */
+void screenchangenotify(xcb_generic_event_t *e)
+{
+    xcb_rectangle_t *old = heads;
+    xcb_randr_crtc_t *oldcrtcs = headcrtcs;
+    int nold = nheads;
+    (void)e;
+
+#ifdef EWMH_TASKBAR
+    Invalidate_Global_Strut();  /* the heads the struts reach into change */
+#endif /* EWMH_TASKBAR */
+
+    xcb_get_geometry_reply_t *geo = xcb_get_geometry_reply(dis,
+                                            xcb_get_geometry(dis, screen->root), NULL);
+    if (geo) {
+        screen->width_in_pixels = geo->width;
+        screen->height_in_pixels = geo->height;
+        free(geo);
+    }
+    heads = NULL;
+    headcrtcs = NULL;
+    setup_heads();
+    if (nheads == nold && !memcmp(heads, old, nheads * sizeof(xcb_rectangle_t))
+        && !memcmp(headcrtcs, oldcrtcs, nheads * sizeof(xcb_randr_crtc_t))) {
+        free(old);
+        free(oldcrtcs);
+        return;     /* one of many notifications of the same change */
+    }
+    DEBUGP("outputs changed: %d -> %d\n", nold, nheads);
+
+    int map[nold];
+    match_heads(old, oldcrtcs, nold, map);
+    for (desktop *desk = (desktop *)get_head(&desktops); desk; desk = (desktop *)get_next(&desk->link)) {
+        monitor *gone[nold];
+        int ngone = 0, goneold[nold];
+        bool have[nheads];
+
+        memset(have, 0, sizeof(have));
+        for (monitor *moni = (monitor *)get_head(&desk->monitors); moni;
+                moni = (monitor *)get_next(&moni->link)) {
+            int n = map[moni->num];
+            if (n < 0) {
+                goneold[ngone] = moni->num;
+                gone[ngone++] = moni;
+                continue;
+            }
+            xcb_rectangle_t *o = &old[moni->num], *h = &heads[n];
+            moni->num = n;
+            moni->crtc = headcrtcs[n];
+            have[n] = true;
+            if (o->x == h->x && o->y == h->y && o->width == h->width && o->height == h->height)
+                continue;
+            monitor_geometry(moni);
+            bool pivot = (o->height > o->width) != (h->height > h->width);
+            for (display *disp = (display *)get_head(&moni->displays); disp;
+                    disp = (display *)get_next(&disp->link)) {
+                if (pivot)
+                    pivot_display(disp);
+                disp->needslayout = true;
+                for (client *c = (client *)get_head(&disp->clients); c; c = M_GETNEXT(c))
+                    if (c->isfullscreen)
+                        xcb_move_resize(dis, c->win, h->x, h->y, h->width, h->height, &c->position_info);
+            }
+        }
+        for (int m = 0; m < nheads; m++)
+            if (!have[m])
+                create_monitor(desk, m);
+        for (int g = 0; g < ngone; g++)
+            remove_monitor(gone[g], nearest_monitor(desk, &old[goneold[g]], gone, ngone),
+                           &old[goneold[g]]);
+        for (int m = 0; m < nheads; m++)    /* back in the order of the outputs */
+            for (monitor *moni = (monitor *)get_head(&desk->monitors); moni;
+                    moni = (monitor *)get_next(&moni->link))
+                if ((int)moni->num == m) {
+                    rem_node(&moni->link);
+                    add_tail(&desk->monitors, &moni->link);
+                    break;
+                }
+    }
+    free(old);
+    free(oldcrtcs);
+
+    select_desktop(shown_desktop);
+    xcb_ewmh_set_desktop_geometry(ewmh, default_screen, screen->width_in_pixels, screen->height_in_pixels);
+    for (monitor *moni = (monitor *)get_head(&current_desktop->monitors); moni;
+            moni = (monitor *)get_next(&moni->link)) {
+        display *disp = (display *)get_head(&moni->displays);
+        if (disp->needslayout)
+            tile_display(disp);
+    }
+    update_current(M_CURRENT);
+}
+
 /* set the specified desktop's properties */
 void select_desktop(int i)
 {
@@ -2673,9 +3428,9 @@ void select_desktop(int i)
         return;
     current_desktop = find_desktop(i);
     if (!current_desktop)
-        current_desktop = (desktop *)get_head(&desktops);
+        current_desktop = create_desktop(i);
     current_desktop_number = current_desktop->num;
-    current_monitor = (monitor *)get_head(&current_desktop->monitors);
+    current_monitor = current_desktop->curmon;
     current_display = (display *)get_head(&current_monitor->displays);
 }
 
@@ -2708,18 +3463,19 @@ void setmaximize(client *c, bool maximize)
 
     int borders = client_borders(c);
     borders = (!M_GETNEXT(M_HEAD) ||
-               (M_MODE == MONOCLE && !ISFMFTM(c) && !MONOCLE_BORDERS)
+               (M_MODE == MONOCLE && c->istiled && !MONOCLE_BORDERS)
               ) ? 0 : borders;
     xcb_border_width(dis, c->win, borders);
 
     if (maximize) {
-        xcb_move_resize(dis, c->win, M_GAPS, M_WY + M_GAPS,
+        xcb_move_resize(dis, c->win, M_WX + M_GAPS, M_WY + M_GAPS,
                         M_WW - 2 * (borders + M_GAPS),
                         M_WH - 2 * (borders + M_GAPS), &c->position_info);
         c->ismaximized = True;
     }
     else
         c->ismaximized = False;
+    client_changed(c);
 
     update_current(c);
 }
@@ -2772,28 +3528,54 @@ int setup_keyboard(void)
     return 0;
 }
 
+/*
+ * set or clear the urgency of a client, keeping the urgency queue and
+ * the urgent count of the client's desktop in sync
+ */
+void set_urgent(client *c, bool urgent)
+{
+    desktop *desk;
+
+    if (c->isurgent == urgent)
+        return;
+    getparents(c, NULL, NULL, &desk);
+    c->isurgent = urgent;
+    suspend_stale = suspending;     /* urgent processes run */
+    if (urgent) {
+        add_tail(&urgents, &c->urgentlink);
+        desk->nurgent++;
+    }
+    else {
+        rem_node(&c->urgentlink);
+        desk->nurgent--;
+    }
+    Emit_IPC_Event(IPC_EV_URGENCY, c->win, urgent);
+}
+
 /* set or unset fullscreen state of client */
 void setfullscreen(client *c, bool fullscrn)
 {
     DEBUGP("xcb: set fullscreen: %d\n", fullscrn);
 
     if (fullscrn) {
-        long data[] = { ewmh->_NET_WM_STATE_FULLSCREEN };
+        monitor *moni;
+        getparents(c, NULL, &moni, NULL);
+        xcb_rectangle_t *h = &heads[moni->num];
         c->isfullscreen = True;
+        client_changed(c);
         xcb_border_width(dis, c->win, 0);
-        xcb_move_resize(dis, c->win, 0, 0, screen->width_in_pixels, screen->height_in_pixels, &c->position_info);
-        xcb_change_property(dis, XCB_PROP_MODE_REPLACE,
-                            c->win, ewmh->_NET_WM_STATE,
-                            XCB_ATOM_ATOM, 32, True, data);
+        xcb_move_resize(dis, c->win, h->x, h->y, h->width, h->height, &c->position_info);
+        set_net_wm_state(c, c->nethidden);
         create_display(c);
     }
     else {
         c->isfullscreen = False;
+        client_changed(c);
         xcb_border_width(dis, c->win,
                      (!M_GETNEXT(M_HEAD) ||
-                      (M_MODE == MONOCLE && !ISFMFTM(c) && !MONOCLE_BORDERS)
+                      (M_MODE == MONOCLE && c->istiled && !MONOCLE_BORDERS)
                      ) ? 0 : client_borders(c));
-        xcb_remove_property(dis, c->win, ewmh->_NET_WM_STATE, ewmh->_NET_WM_STATE_FULLSCREEN);
+        set_net_wm_state(c, c->nethidden);
         destroy_display(c);
     }
     update_current(c);
@@ -2839,10 +3621,13 @@ int setup(int default_screen)
         err(EXIT_FAILURE, "error: other wm is running\n");
 
     /* initialize apprule regexes */
-    for (unsigned int i = 0; i < LENGTH(rules); i++)
+    suspending = SUSPEND_DESKTOPS != 0;
+    for (unsigned int i = 0; i < LENGTH(rules); i++) {
         if (regcomp(&classruleregex[i], rules[i].class, 0) ||
          regcomp(&instanceruleregex[i], rules[i].instance, 0))
             err(EXIT_FAILURE, "error: failed to compile rule regexes\n");
+        suspending = suspending || rules[i].suspend;
+    }
 
     /* initialize EWMH */
     ewmh = calloc(1, sizeof(xcb_ewmh_connection_t));
@@ -2855,6 +3640,7 @@ int setup(int default_screen)
     xcb_atom_t net_atoms[] = { ewmh->_NET_SUPPORTED,
 #ifdef EWMH_TASKBAR
                                ewmh->_NET_CLIENT_LIST,
+                               ewmh->_NET_CLIENT_LIST_STACKING,
                                ewmh->_NET_WM_STRUT,
                                ewmh->_NET_WM_STRUT_PARTIAL,
 #endif /* EWMH_TASKBAR */
@@ -2887,7 +3673,7 @@ int setup(int default_screen)
     xcb_ewmh_set_supporting_wm_check(ewmh, screen->root, checkwin);
     xcb_ewmh_set_number_of_desktops(ewmh, default_screen, DESKTOPS);
     xcb_ewmh_set_current_desktop(ewmh, default_screen, DEFAULT_DESKTOP);
-    xcb_ewmh_set_desktop_geometry(ewmh, default_screen, M_WW, M_WH);
+    xcb_ewmh_set_desktop_geometry(ewmh, default_screen, screen->width_in_pixels, screen->height_in_pixels);
     xcb_ewmh_set_desktop_viewport(ewmh, default_screen, 1, viewports);
     xcb_ewmh_set_workarea(ewmh, default_screen, 1, workarea);
     xcb_ewmh_set_showing_desktop(ewmh, default_screen, 0);
@@ -2918,6 +3704,15 @@ int setup(int default_screen)
     events[XCB_PROPERTY_NOTIFY]     = propertynotify;
     events[XCB_UNMAP_NOTIFY]        = unmapnotify;
 
+    /* follow outputs coming, going and changing */
+    const xcb_query_extension_reply_t *rr = xcb_get_extension_data(dis, &xcb_randr_id);
+    if (rr && rr->present && rr->first_event + XCB_RANDR_NOTIFY < XCB_NO_OPERATION) {
+        xcb_randr_select_input(dis, screen->root, XCB_RANDR_NOTIFY_MASK_SCREEN_CHANGE
+                                                | XCB_RANDR_NOTIFY_MASK_CRTC_CHANGE);
+        events[rr->first_event + XCB_RANDR_SCREEN_CHANGE_NOTIFY] = screenchangenotify;
+        events[rr->first_event + XCB_RANDR_NOTIFY] = screenchangenotify;
+    }
+
     /* grab existing windows */
     xcb_query_tree_reply_t *reply;
 
@@ -2944,13 +3739,19 @@ int setup(int default_screen)
                 && attr->_class != XCB_WINDOW_CLASS_INPUT_ONLY) {
                 uint32_t dsk = cd;
 
-                if (scrpd_atom && !scrpd) {
-                    if (xcb_check_attribute(dis, children[i], scrpd_atom)) {
-                        scrpd = create_client(children[i], wtype);
-                        setwindefattr(scrpd->win);
-                        grabbuttons(scrpd);
-                        xcb_move(dis, scrpd->win, -2 * M_WW, 0, &scrpd->position_info);
-                        showscratchpad = False;
+                if (scrpd_atom && xcb_check_attribute(dis, children[i], scrpd_atom)) {
+                    xcb_icccm_get_wm_class_reply_t wclass;
+                    int n = -1;
+                    if (xcb_icccm_get_wm_class_reply(dis, xcb_icccm_get_wm_class_unchecked(dis, children[i]),
+                                                     &wclass, NULL)) {
+                        for (unsigned int s = 0; n < 0 && s < LENGTH(scratchpads); s++)
+                            if (!scrpds[s] && !strcmp(wclass.instance_name, scratchpads[s].name))
+                                n = s;
+                        xcb_icccm_get_wm_class_reply_wipe(&wclass);
+                    }
+                    if (n >= 0) {   /* a scratchpad left behind by the last run */
+                        adopt_scratchpad(n, children[i], wtype);
+                        free(attr);
                         continue;
                     }
                 }
@@ -3023,13 +3824,17 @@ int setup(int default_screen)
                     select_desktop(dsk);
                 client *c = addwindow(children[i], wtype);
 
+                if (UNMAP_HIDDEN && cd != dsk && !case7) {
+                    c->ishidden = true;                                         /* case 6 */
+                    set_wm_state(c->win, XCB_ICCCM_WM_STATE_ICONIC);
+                }
                 if (doMinimize)
                     minimize_client(c);
                 if (case7)
-                    xcb_move(dis, c->win, -2 * M_WW, 0, &c->position_info);
+                    hide_client(c);
                 grabbuttons(c);
                 if (cd != dsk) {
-                    xcb_move(dis, c->win, -2 * M_WW, 0, &c->position_info);
+                    hide_client(c);
                     select_desktop(cd);
                 }
             }
@@ -3041,70 +3846,289 @@ int setup(int default_screen)
     change_desktop(&(Arg){.i = DEFAULT_DESKTOP});
     switch_mode(&(Arg){.i = DEFAULT_MODE});
 
-    /* open the scratchpad terminal if enabled */
-    if (USE_SCRATCHPAD && !scrpd)
-        spawn(&(Arg){.com = scrpcmd});
+    /* before anything is started, so it inherits FRANKENWM_SOCKET */
+    if (IPC)
+        Setup_IPC();
+
+    /* start the scratchpads if enabled, they wait hidden until toggled */
+    for (unsigned int i = 0; USE_SCRATCHPAD && i < LENGTH(scratchpads); i++)
+        spawn_scratchpad(i);
 
 #ifdef EWMH_TASKBAR
     Setup_EWMH_Taskbar_Support();
     Setup_Global_Strut();
 #endif
+    if (SHM_STATE)
+        Setup_Shm_State();
 
     return 0;
 }
 
-static void setup_display(void)
+/* set the work area of a monitor to the geometry of its output */
+static void monitor_geometry(monitor *moni)
 {
-    desktops.head = desktops.tail = NULL;
-    for (int d = 0; d < DESKTOPS; d++) {
-        desktop *desk;
-        if (!(desk = calloc(1, sizeof(desktop))))
-            err(EXIT_FAILURE, "cannot allocate desktop");
-        add_tail(&desktops, &desk->link);
-        desk->monitors.master = desk;
-        desk->num = d;
-
-        for (int m = 0; m < MONITORS; m++) {
-            monitor *moni;
-            display *disp;
-            if (!(moni = calloc(1, sizeof(monitor))))
-                err(EXIT_FAILURE, "cannot allocate monitor");
-            add_tail(&desk->monitors, &moni->link);
-            moni->displays.master = moni;
-
-/* TODO: multi monitor support */
-            moni->num = m;
-            moni->ww = screen->width_in_pixels;
-            moni->wh = screen->height_in_pixels;
+    moni->wx = heads[moni->num].x;
+    moni->wy = heads[moni->num].y;
+    moni->ww = heads[moni->num].width;
+    moni->wh = heads[moni->num].height;
 #ifndef EWMH_TASKBAR
-            moni->wh -= PANEL_HEIGHT;
+    moni->wh -= PANEL_HEIGHT;
 #endif /* EWMH_TASKBAR */
+}
+
+/* pivot monitor support, swap the tile and bottom stack modes of a display */
+static void pivot_display(display *disp)
+{
+    if (disp->di.mode == TILE)
+        disp->di.mode = BSTACK;
+    else if (disp->di.mode == BSTACK)
+        disp->di.mode = TILE;
+}
+
+/* allocate monitor number m of desktop desk with its default display */
+static monitor *create_monitor(desktop *desk, int m)
+{
+    monitor *moni;
+    display *disp;
+
+    if (!(moni = calloc(1, sizeof(monitor))))
+        err(EXIT_FAILURE, "cannot allocate monitor");
+    add_tail(&desk->monitors, &moni->link);
+    moni->displays.master = moni;
+    moni->num = m;
+    moni->crtc = headcrtcs[m];
+    monitor_geometry(moni);
 
 /* each monitor gets 1 default display. */
-            if (!(disp = calloc(1, sizeof(display))))
-                err(EXIT_FAILURE, "cannot allocate display");
-            add_tail(&moni->displays, &disp->link);
-            disp->clients.master = disp;
-
-            /* disp->di.master_size = MASTER_SIZE; */
-            disp->di.gaps = USELESSGAP;
-            disp->di.mode = DEFAULT_MODE;
-            disp->di.showpanel = SHOW_PANEL;
-            disp->di.invert = INVERT;
-
-/* Pivot monitor support */
-            if (moni->wh > moni->ww) {
-                if (disp->di.mode == TILE)
-                    disp->di.mode = BSTACK;
-                else {
-                    if (disp->di.mode == BSTACK)
-                        disp->di.mode = TILE;
-                }
+    if (!(disp = pool_alloc(&displaypool)))
+        err(EXIT_FAILURE, "cannot allocate display");
+    add_tail(&moni->displays, &disp->link);
+    disp->clients.master = disp;
+    disp->di = defaultdi;
+    if (moni->wh > moni->ww)
+        pivot_display(disp);
+    return moni;
+}
+
+/*
+ * allocate desktop number d with a display for each monitor and link it
+ * into the desktops list in order. desktops are only created on first use.
+ */
+static desktop *create_desktop(int d)
+{
+    desktop *desk, *prev = NULL;
+
+    if (!(desk = calloc(1, sizeof(desktop))))
+        err(EXIT_FAILURE, "cannot allocate desktop");
+    for (int p = d - 1; p >= 0 && !(prev = desktop_index[p]); p--)
+        ;
+    if (prev)
+        insert_node_after(&desktops, &prev->link, &desk->link);
+    else
+        add_head(&desktops, &desk->link);
+    desktop_index[d] = desk;
+    desk->monitors.master = desk;
+    desk->num = d;
+
+    for (int m = 0; m < nheads; m++)
+        create_monitor(desk, m);
+    desk->curmon = (monitor *)get_head(&desk->monitors);
+    return desk;
+}
+
+/*
+ * free a desktop that has no clients and is not shown, if RECLAIM_DESKTOPS
+ * is set. it is created again with the default settings when it is needed.
+ */
+static void reclaim_desktop(desktop *desk)
+{
+    monitor *moni;
+
+    if (!RECLAIM_DESKTOPS || !desk || desk == current_desktop
+        || (int)desk->num == shown_desktop || desktop_populated(desk))
+        return;
+    while ((moni = (monitor *)rem_head(&desk->monitors))) {
+        display *disp;
+        while ((disp = (display *)rem_head(&moni->displays))) {
+            free(disp->tiled);
+            free(disp->borders);
+            free(disp->rects);
+            pool_free(&displaypool, disp);
+        }
+        free(moni);
+    }
+    desktop_index[desk->num] = NULL;
+    rem_node(&desk->link);
+    free(desk);
+}
+
+/*
+ * the output of monitor moni is gone, move its clients to the default
+ * display of monitor to and free it. fullscreen clients fall back to
+ * normal ones, floating clients keep their place relative to the output,
+ * which was at old.
+ */
+static void remove_monitor(monitor *moni, monitor *to, const xcb_rectangle_t *old)
+{
+    desktop *desk = moni->link.parent->master;
+    display *base = (display *)get_tail(&to->displays), *disp;
+    bool shown = (int)desk->num == shown_desktop && show,
+         toshown = shown && (display *)get_head(&to->displays) == base;
+    int dx = heads[to->num].x - old->x, dy = heads[to->num].y - old->y;
+
+    while ((disp = (display *)get_head(&moni->displays))) {
+        bool visible = shown && !get_prev(&disp->link);  /* was on screen */
+        client *c;
+        node *n;
+
+        while ((n = rem_head(&disp->miniq)))
+            add_tail(&base->miniq, n);
+        while ((c = (client *)rem_head(&disp->clients))) {
+            add_tail(&base->clients, &c->link);
+            if (c->isfullscreen) {
+                c->isfullscreen = false;
+                client_changed(c);
+                xcb_border_width(dis, c->win, client_borders(c));
+                set_net_wm_state(c, c->nethidden);
+            }
+            if (c->isfloating) {
+                posxy_t *pi = &c->position_info;
+                if (!UNMAP_HIDDEN && (!visible || c->isminimized)) {
+                    pi->previous_x += dx;   /* offscreen, where show_client() looks */
+                    pi->previous_y += dy;
+                } else
+                    xcb_move(dis, c->win, pi->current_x + dx, pi->current_y + dy, pi);
+            }
+            if (c->isminimized)
+                continue;
+            if (visible && !toshown)
+                hide_client(c);
+            else if (!visible && toshown)
+                show_client(c);
+        }
+        rem_node(&disp->link);
+        free(disp->tiled);
+        free(disp->borders);
+        free(disp->rects);
+        pool_free(&displaypool, disp);
+    }
+    base->needslayout = true;   /* its tiled clients are still on the old output */
+    if (desk->curmon == moni)
+        desk->curmon = to;
+    if (current_monitor == moni) {
+        current_monitor = to;
+        current_display = (display *)get_head(&to->displays);
+    }
+    rem_node(&moni->link);
+    free(moni);
+}
+
+static int cmp_heads(const xcb_rectangle_t *x, const xcb_rectangle_t *y)
+{
+    return x->x != y->x ? x->x - y->x : x->y - y->y;
+}
+
+/* allocate room for n heads and their CRTCs */
+static void alloc_heads(int n)
+{
+    free(heads);
+    free(headcrtcs);
+    if (!(heads = calloc(n, sizeof(xcb_rectangle_t))) || !(headcrtcs = calloc(n, sizeof(xcb_randr_crtc_t))))
+        err(EXIT_FAILURE, "cannot allocate heads");
+}
+
+/*
+ * find the outputs of the screen, one monitor is made for each. RandR is
+ * asked first, then Xinerama, and without either the whole screen is one
+ * output. outputs cloning another one are left out, the rest is sorted
+ * left to right so monitor numbers follow the physical order.
+ */
+static void setup_heads(void)
+{
+    free(heads);
+    free(headcrtcs);
+    heads = NULL;
+    headcrtcs = NULL;
+    nheads = 0;
+
+    const xcb_query_extension_reply_t *ext = xcb_get_extension_data(dis, &xcb_randr_id);
+    xcb_randr_get_screen_resources_current_reply_t *res = NULL;
+    if (ext && ext->present)
+        res = xcb_randr_get_screen_resources_current_reply(dis,
+                xcb_randr_get_screen_resources_current(dis, screen->root), NULL);
+    if (res) {
+        int n = xcb_randr_get_screen_resources_current_crtcs_length(res);
+        xcb_randr_crtc_t *crtcs = xcb_randr_get_screen_resources_current_crtcs(res);
+        xcb_randr_get_crtc_info_cookie_t cookies[n];
+        if (n)
+            alloc_heads(n);
+        for (int i = 0; i < n; i++)
+            cookies[i] = xcb_randr_get_crtc_info(dis, crtcs[i], res->config_timestamp);
+        for (int i = 0; i < n; i++) {
+            xcb_randr_get_crtc_info_reply_t *crtc = xcb_randr_get_crtc_info_reply(dis, cookies[i], NULL);
+            if (!crtc)
+                continue;
+            int j;
+            for (j = 0; j < nheads && (heads[j].x != crtc->x || heads[j].y != crtc->y); j++) ;
+            if (crtc->mode && crtc->width && crtc->height && j == nheads) {
+                headcrtcs[nheads] = crtcs[i];
+                heads[nheads++] = (xcb_rectangle_t){ crtc->x, crtc->y, crtc->width, crtc->height };
+            }
+            free(crtc);
+        }
+        free(res);
+    }
+
+    if (!nheads) {
+        xcb_xinerama_is_active_reply_t *act = NULL;
+        ext = xcb_get_extension_data(dis, &xcb_xinerama_id);
+        if (ext && ext->present)
+            act = xcb_xinerama_is_active_reply(dis, xcb_xinerama_is_active(dis), NULL);
+        if (act && act->state) {
+            xcb_xinerama_query_screens_reply_t *xsq = xcb_xinerama_query_screens_reply(dis,
+                                                        xcb_xinerama_query_screens(dis), NULL);
+            if (xsq) {
+                int n = xcb_xinerama_query_screens_screen_info_length(xsq);
+                xcb_xinerama_screen_info_t *info = xcb_xinerama_query_screens_screen_info(xsq);
+                if (n)
+                    alloc_heads(n);
+                for (int i = 0; i < n; i++)
+                    heads[nheads++] = (xcb_rectangle_t){ info[i].x_org, info[i].y_org,
+                                                         info[i].width, info[i].height };
+                free(xsq);
             }
         }
+        free(act);
+    }
+
+    if (!nheads) {
+        alloc_heads(1);
+        heads[nheads++] = (xcb_rectangle_t){ 0, 0, screen->width_in_pixels, screen->height_in_pixels };
     }
-    current_desktop = (desktop *)get_head(&desktops);
-    current_monitor = (monitor *)get_head(&current_desktop->monitors);
+    for (int i = 1; i < nheads; i++)       /* a few outputs, the CRTCs go along */
+        for (int j = i; j > 0 && cmp_heads(&heads[j - 1], &heads[j]) > 0; j--) {
+            xcb_rectangle_t r = heads[j];
+            xcb_randr_crtc_t crtc = headcrtcs[j];
+            heads[j] = heads[j - 1];
+            headcrtcs[j] = headcrtcs[j - 1];
+            heads[j - 1] = r;
+            headcrtcs[j - 1] = crtc;
+        }
+}
+
+static void setup_display(void)
+{
+    desktops.head = desktops.tail = NULL;
+    setup_heads();
+
+    /* disp->di.master_size = MASTER_SIZE; */
+    defaultdi.gaps = USELESSGAP;
+    defaultdi.mode = DEFAULT_MODE;
+    defaultdi.showpanel = SHOW_PANEL;
+    defaultdi.invert = INVERT;
+
+    current_desktop = create_desktop(0);
+    current_monitor = current_desktop->curmon;
     current_display = (display *)get_head(&current_monitor->displays);
 }
 
@@ -3123,16 +4147,19 @@ static void setwindefattr(xcb_window_t w)
  */
 void showhide(void)
 {
-    if ((show = !show)) {
-        for (client *c = (client *)get_node_head(&M_HEAD->link); c; c = M_GETNEXT(c))
-            xcb_move(dis, c->win, c->position_info.previous_x, c->position_info.previous_y, &c->position_info);
-        tile();
-        xcb_ewmh_set_showing_desktop(ewmh, default_screen, 1);
-    } else {
-        for (client *c = (client *)get_node_head(&M_HEAD->link); c; c = M_GETNEXT(c))
-            xcb_move(dis, c->win, -2 * M_WW, 0, &c->position_info);
-        xcb_ewmh_set_showing_desktop(ewmh, default_screen, 0);
+    show = !show;
+    for (monitor *moni = (monitor *)get_head(&current_desktop->monitors); moni;
+            moni = (monitor *)get_next(&moni->link)) {
+        display *disp = (display *)get_head(&moni->displays);
+        for (client *c = (client *)get_head(&disp->clients); c; c = M_GETNEXT(c))
+            show ? show_client(c) : hide_client(c);
+        if (show) {
+            disp->needslayout = true;   /* a pass while hidden left them offscreen */
+            tile_display(disp);
+        }
     }
+    visibility_stale = true;
+    xcb_ewmh_set_showing_desktop(ewmh, default_screen, show);
 }
 
 void sigchld()
@@ -3142,115 +4169,28 @@ void sigchld()
     while (0 < waitpid(-1, NULL, WNOHANG));
 }
 
-/* execute a command, save the child pid if we start the scratchpad */
+/*
+ * execute a command in a session of its own. posix_spawn() does not copy
+ * the address space like fork() does, so a launch costs the same however
+ * much memory the window manager holds. the X connection is close-on-exec
+ * and does not leak into the command.
+ */
 void spawn(const Arg *arg)
 {
-    if (fork())
-        return;
-    if (dis)
-        close(screen->root);
-    setsid();
-    execvp((char *)arg->com[0], (char **)arg->com);
-    err(EXIT_SUCCESS, "error: execvp %s", (char *)arg->com[0]);
-}
+    posix_spawnattr_t attr;
+    pid_t pid;
+    int e;
 
-/* arrange windows in normal or bottom stack tile */
-void stack(int hh, int cy)
-{
-    client *c = NULL, *t = NULL; bool b = M_MODE == BSTACK;
-    int n = 0, d = 0, z = b ? M_WW : hh,
-        ma = (M_MODE == BSTACK ? M_WH : M_WW) * MASTER_SIZE + M_MASTER_SIZE;
-
-    /* count stack windows and grab first non-floating, non-maximize window */
-    for (t = M_HEAD; t; t = M_GETNEXT(t)) {
-        if (!ISFMFTM(t)) {
-            if (c)
-                ++n;
-            else
-                c = t;
-        }
-    }
-
-    /*
-     * if there is only one window, it should cover the available screen space
-     * if there is only one stack window (n == 1) then we don't care about
-     * growth if more than one stack windows (n > 1) on screen then adjustments
-     * may be needed
-     *   - d is the num of pixels than remain when spliting
-     *   the available width/height to the number of windows
-     *   - z is the clients' height/width
-     *
-     *      ----------  -.    --------------------.
-     *      |   |----| --|--> growth               `}--> first client will get
-     *      |   |    |   |                          |    (z+d) height/width
-     *      |   |----|   }--> screen height - hh  --'
-     *      |   |    | }-|--> client height - z
-     *      ----------  -'
-     *
-     *     ->  piece of art by c00kiemon5ter o.O om nom nom nom nom
-     *
-     *     what we do is, remove the growth from the screen height   : (z -
-     *     growth) and then divide that space with the windows on the stack  :
-     *     (z - growth)/n so all windows have equal height/width (z)
-     *     : growth is left out and will later be added to the first's client
-     *     height/width before that, there will be cases when the num of
-     *     windows is not perfectly divided with then available screen
-     *     height/width (ie 100px scr. height, and 3 windows) so we get that
-     *     remaining space and merge growth to it (d) : (z - growth) % n +
-     *     growth finally we know each client's height, and how many pixels
-     *     should be added to the first stack window so that it satisfies
-     *     growth, and doesn't create gaps
-     *     on the bottom of the screen.
-     */
-    if (!c) {
-        return;
-    } else if (!n) {
-        int borders = client_borders(c);
-        xcb_move_resize(dis, c->win, M_GAPS, cy + M_GAPS,
-                        M_WW - 2 * (borders + M_GAPS),
-                        hh - 2 * (borders + M_GAPS), &c->position_info);
-        return;
-    } else if (n > 1) {
-        d = (z - M_GROWTH) % n + M_GROWTH; z = (z - M_GROWTH) / n;
-    }
-
-    /* tile the first non-floating, non-maximize window to cover the master area */
-    int borders = client_borders(c);
-    if (b)
-        xcb_move_resize(dis, c->win, M_GAPS,
-                        M_INVERT ? (cy + hh - ma + M_GAPS) : (cy + M_GAPS),
-                        M_WW - 2 * (borders + M_GAPS),
-                        ma - 2 * (borders + M_GAPS), &c->position_info);
-    else
-        xcb_move_resize(dis, c->win, M_INVERT ? (M_WW - ma + M_GAPS) : M_GAPS,
-                        cy + M_GAPS,
-                        ma - 2 * (borders + M_GAPS),
-                        hh - 2 * (borders + M_GAPS), &c->position_info);
-
-    /* tile the next non-floating, non-maximize (first) stack window with growth|d */
-    for (c = M_GETNEXT(c); c && ISFMFTM(c); c = M_GETNEXT(c));
-    borders = client_borders(c);
-    int cx = b ? 0 : (M_INVERT ? M_GAPS : ma),
-        cw = (b ? hh : M_WW) - 2 * borders - ma - M_GAPS,
-        ch = z - 2 * borders - M_GAPS;
-    if (b)
-        xcb_move_resize(dis, c->win, cx += M_GAPS, cy += M_INVERT ? M_GAPS : ma,
-                        ch - M_GAPS + d, cw, &c->position_info);
-    else
-        xcb_move_resize(dis, c->win, cx, cy += M_GAPS, cw, ch - M_GAPS + d, &c->position_info);
-
-    /* tile the rest of the non-floating, non-maximize stack windows */
-    for (b ? (cx += z + d - M_GAPS) : (cy += z + d - M_GAPS),
-         c = M_GETNEXT(c); c; c = M_GETNEXT(c)) {
-        if (ISFMFTM(c))
-            continue;
-        if (b) {
-            xcb_move_resize(dis, c->win, cx, cy, ch, cw, &c->position_info); cx += z;
-        } else {
-            xcb_move_resize(dis, c->win, cx, cy, cw, ch, &c->position_info); cy += z;
-        }
-    }
-}
+    posix_spawnattr_init(&attr);
+#ifdef POSIX_SPAWN_SETSID
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSID);
+#else
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP);     /* a group of its own */
+#endif
+    if ((e = posix_spawnp(&pid, arg->com[0], NULL, &attr, (char *const *)arg->com, environ)))
+        warnx("cannot spawn %s: %s", arg->com[0], strerror(e));
+    posix_spawnattr_destroy(&attr);
+}
 
 /* swap master window with current or
  * if current is head swap with next
@@ -3300,19 +4240,102 @@ void rotate_mode(const Arg *arg)
     desktopinfo();
 }
 
-/* tile all windows of current desktop - call the handler tiling function */
+/* focus the next or previous monitor */
+void rotate_monitor(const Arg *arg)
+{
+    if (nheads < 2)
+        return;
+    select_monitor(find_monitor(((int)current_monitor->num + arg->i % nheads + nheads) % nheads));
+    update_current(M_CURRENT);
+    desktopinfo();
+}
+
+/*
+ * tile all windows of current desktop - run the layout kernel of the mode
+ * and move the windows into the computed places
+ * h - avaible height that windows have to expand
+ * y - offset from top to place the windows (reserved by the panel)
+ */
 void tile(void)
 {
     desktopinfo();
+    if (current_desktop_number != shown_desktop) {
+        current_display->needslayout = true;    /* lay it out when shown */
+        return;
+    }
     if (!M_HEAD)
         return; /* nothing to arange */
+    update_tiled(current_display);
 #ifndef EWMH_TASKBAR
-    layout[M_GETNEXT(M_HEAD) ? M_MODE : MONOCLE](M_WH + (M_SHOWPANEL ? 0 : PANEL_HEIGHT),
-                                (TOP_PANEL && M_SHOWPANEL ? PANEL_HEIGHT : 0));
+    int h = M_WH + (M_SHOWPANEL ? 0 : PANEL_HEIGHT),
+        y = M_WY + (TOP_PANEL && M_SHOWPANEL ? PANEL_HEIGHT : 0);
 #else
     Update_Global_Strut();
-    layout[M_GETNEXT(M_HEAD) ? M_MODE : MONOCLE](M_WH, M_WY);
+    int h = M_WH, y = M_WY;
 #endif /* EWMH_TASKBAR */
+    layoutparams p = {
+        .ww = M_WW, .wh = M_WH, .x = M_WX, .h = h, .y = y,
+        .gaps = M_GAPS, .growth = M_GROWTH, .invert = M_INVERT,
+        .mratio = MASTER_SIZE, .msize = M_MASTER_SIZE, .minwsz = MINWSZ,
+        .headborder = client_borders(M_HEAD), .headtiled = M_HEAD->istiled,
+        .monoborder = MONOCLE_BORDERS && M_CURRENT ? 2 * client_borders(M_CURRENT) : 0,
+    };
+    display *disp = current_display;
+    client **t = disp->tiled;
+    rect *r = disp->rects;
+    int mode = M_GETNEXT(M_HEAD) ? M_MODE : MONOCLE;
+    bool same = !disp->needslayout && disp->laidgen == disp->tiledgen
+                && disp->laidmode == mode && layout_params_equal(&p, &disp->laid);
+
+    for (unsigned int i = 0; i < disp->ntiled; i++) {
+        int b = client_borders(t[i]);
+        same = same && disp->borders[i] == b;
+        disp->borders[i] = b;
+    }
+    if (same)
+        return; /* the windows are still where the last pass put them */
+
+    layout[mode](&p, disp->ntiled, disp->borders, r);
+    for (unsigned int i = 0; i < disp->ntiled; i++) {
+        if (r[i].x == LAYOUT_UNPLACED)
+            continue;
+        if (SIZE_HINTS)     /* a size the window takes as is, or it asks again */
+            layout_hints(&t[i]->hints, &r[i], HINTS_CENTER);
+        xcb_move_resize(dis, t[i]->win, r[i].x, r[i].y, r[i].w, r[i].h, &t[i]->position_info);
+    }
+    disp->laid = p;
+    disp->laidmode = mode;
+    disp->laidgen = disp->tiledgen;
+    disp->needslayout = false;
+}
+
+/*
+ * tile() display disp wherever it is, the current desktop, monitor and
+ * display stay what they are. a display that is not on screen, or all of
+ * them while hidden by showhide(), is laid out once it is shown.
+ */
+static void tile_display(display *disp)
+{
+    desktop *cd = current_desktop;
+    monitor *cm = current_monitor, *moni = disp->link.parent->master;
+    display *cdisp = current_display;
+    int cn = current_desktop_number;
+
+    current_desktop = moni->link.parent->master;
+    if ((int)current_desktop->num != shown_desktop || !show
+        || disp != (display *)get_head(&moni->displays)) {
+        current_desktop = cd;
+        disp->needslayout = true;
+        return;
+    }
+    current_desktop_number = current_desktop->num;
+    current_monitor = moni;
+    current_display = disp;
+    tile();
+    current_desktop = cd;
+    current_desktop_number = cn;
+    current_monitor = cm;
+    current_display = cdisp;
 }
 
 /* reset the active window from floating to tiling, if not already */
@@ -3331,38 +4354,100 @@ void togglepanel()
     tile();
 }
 
+/* the index of the scratchpad with window win, -1 if it is none */
+static int find_scratchpad(xcb_window_t win)
+{
+    for (unsigned int i = 0; i < LENGTH(scratchpads); i++)
+        if (scrpds[i] && scrpds[i]->win == win)
+            return i;
+    return -1;
+}
+
 /*
- * Toggle the scratchpad terminal, also attempt to reopen it if it is
- * not present.
+ * run the command of scratchpad n, unless it already has a window. one that
+ * dies within SCRPDRESPAWN seconds is not restarted by destroynotify(), a
+ * crashing command is left to the next toggle.
  */
-void togglescratchpad()
+static void spawn_scratchpad(int n)
 {
-    if (!USE_SCRATCHPAD) {
+    if (scrpds[n])
         return;
-    } else if (!scrpd) {
-        spawn(&(Arg){.com = scrpcmd});
-        showscratchpad = false;
-        if (!scrpd)
-            return;
+    spawn(&(Arg){.com = scratchpads[n].com});
+    scrpdstarting[n] = true;
+    scrpdstarted[n] = now_ms();
+}
+
+/* manage win as scratchpad n, it stays mapped offscreen until shown */
+static void adopt_scratchpad(int n, xcb_window_t win, xcb_atom_t wtype)
+{
+    client *c = scrpds[n] = create_client(win, wtype);
+
+    scrpdstarting[n] = false;
+    setwindefattr(win);
+    grabbuttons(c);
+    xcb_move(dis, win, -2 * M_WW, 0, &c->position_info);
+    if (scrpd_atom)
+        xcb_change_property(dis, XCB_PROP_MODE_REPLACE, win, scrpd_atom,
+                            XCB_ATOM_WINDOW, 32, 1, &win);
+}
+
+/* move the shown scratchpad away and give the focus back */
+static void hide_scratchpad(void)
+{
+    showscratchpad = false;
+    xcb_move(dis, scrpd->win, -2 * M_WW, 0, &scrpd->position_info);
+#ifdef EWMH_TASKBAR
+    Remove_EWMH_Client(scrpd->win);
+#endif /* EWMH_TASKBAR */
+    if(M_CURRENT == scrpd) {
+        if(!M_PREVFOCUS)
+            update_current(M_HEAD);
+        else
+            update_current(M_PREVFOCUS->isminimized ? M_HEAD : M_PREVFOCUS);
     }
+}
 
-    showscratchpad = !showscratchpad;
+/*
+ * Toggle the nth scratchpad, hiding any other one. The scratchpads wait
+ * offscreen, so this is a move and a focus. One that is still starting or
+ * was closed is shown as soon as its window maps, toggling it again before
+ * that gives up on it.
+ */
+void togglescratchpad(const Arg *arg)
+{
+    int n = arg->i;
 
-    if (showscratchpad) {
-        xcb_get_geometry_reply_t *wa = get_geometry(scrpd->win);
-        xcb_move(dis, scrpd->win, (M_WW - wa->width) / 2, (M_WH - wa->height) / 2, &scrpd->position_info);
-        free(wa);
-        update_current(scrpd);
-        xcb_raise_window(dis, scrpd->win);
-    } else {
-        xcb_move(dis, scrpd->win, -2 * M_WW, 0, &scrpd->position_info);
-        if(M_CURRENT == scrpd) {
-            if(!M_PREVFOCUS)
-                update_current(M_HEAD);
-            else
-                update_current(M_PREVFOCUS->isminimized ? M_HEAD : M_PREVFOCUS);
+    if (!USE_SCRATCHPAD || n < 0 || n >= (int)LENGTH(scratchpads))
+        return;
+    if (!scrpds[n]) {
+        if (scrpdpending == n) {
+            scrpdpending = -1;
+            scrpdstarting[n] = false;   /* start it again next time */
+        } else {
+            if (!scrpdstarting[n])
+                spawn_scratchpad(n);
+            scrpdpending = n;
         }
+        return;
     }
+    scrpdpending = -1;
+
+    bool shown = showscratchpad && scrpd == scrpds[n];
+    if (showscratchpad)
+        hide_scratchpad();
+    if (shown)
+        return;
+
+    scrpd = scrpds[n];
+    showscratchpad = true;
+    xcb_get_geometry_reply_t *wa = get_geometry(scrpd->win);
+    xcb_move(dis, scrpd->win, M_WX + (M_WW - wa->width) / 2, M_WY + (M_WH - wa->height) / 2, &scrpd->position_info);
+    free(wa);
+#ifdef EWMH_TASKBAR
+    Add_EWMH_Client(scrpd->win);
+#endif /* EWMH_TASKBAR */
+    update_current(scrpd);
+    xcb_raise_window(dis, scrpd->win);
 }
 
 /* tile a floating client and save its size for re-floating */
@@ -3372,6 +4457,7 @@ void unfloat_client(client *c)
         return;
 
     c->isfloating = false;
+    client_changed(c);
 
     xcb_get_geometry_reply_t *r = get_geometry(c->win);
     c->dim[0] = r->width;
@@ -3396,12 +4482,23 @@ void unmapnotify(xcb_generic_event_t *e)
 
     DEBUG("xcb: unmap notify");
 
-    if (c && on_current_desktop(c)) {
+    if (c && c->unmaps && !(ev->response_type & 0x80)) {
+        c->unmaps--;    /* hidden by hide_client() */
+        return;
+    }
+    if (c && (on_current_desktop(c) || c->ishidden)) {
+        if (UNMAP_HIDDEN)
+            set_wm_state(c->win, XCB_ICCCM_WM_STATE_WITHDRAWN);
         if (c->isfullscreen)
             destroy_display(c);
         removeclient(c);
         desktopinfo();
     }
+    else if (!c) {
+        alien *a = wintoalien(&aliens, ev->window);
+        if (a)
+            dock_changed(a);
+    }
 }
 
 /*
@@ -3427,12 +4524,24 @@ static inline void nada(void)
         xcb_delete_property(dis, screen->root, ewmh->_NET_ACTIVE_WINDOW);
         xcb_set_input_focus(dis, XCB_INPUT_FOCUS_POINTER_ROOT, screen->root, XCB_CURRENT_TIME);
         M_PREVFOCUS = M_CURRENT = NULL;
+#ifdef EWMH_TASKBAR
+        Update_EWMH_Client_List_Stacking();
+#endif /* EWMH_TASKBAR */
 }
-void update_current(client *newfocus)   // newfocus may be NULL
+/* everything update_current() does but the focus, false if nothing can get it */
+static bool arrange_current(client *newfocus)
 {
+    if (newfocus && newfocus != scrpd) {    /* the focus may change monitor */
+        monitor *moni;
+        desktop *desk;
+        getparents(newfocus, NULL, &moni, &desk);
+        if (desk == current_desktop)
+            select_monitor(moni);
+    }
+    visibility_stale = true;
     if(!M_HEAD && USE_SCRATCHPAD && !showscratchpad) {                // empty desktop. no clients, no scratchpad.
         nada();
-        return;
+        return false;
     }
 
     if(!newfocus) {
@@ -3458,7 +4567,7 @@ void update_current(client *newfocus)   // newfocus may be NULL
 
     if(!M_CURRENT) {  // there is really really really nothing to focus.
         nada();
-        return;
+        return false;
     }
 
     for (client *c = M_HEAD; c; c = M_GETNEXT(c)) {
@@ -3466,7 +4575,7 @@ void update_current(client *newfocus)   // newfocus may be NULL
             xcb_change_window_attributes(dis, c->win, XCB_CW_BORDER_PIXEL,
                                     (c == M_CURRENT ? &win_focus : &win_unfocus));
             xcb_border_width(dis, c->win, ((!MONOCLE_BORDERS && !M_GETNEXT(M_HEAD))
-                                        || (M_MODE == MONOCLE && !ISFMFTM(c) && !MONOCLE_BORDERS)
+                                        || (M_MODE == MONOCLE && c->istiled && !MONOCLE_BORDERS)
                                            ) ? 0 : client_borders(c));
         }
     }
@@ -3506,6 +4615,10 @@ void update_current(client *newfocus)   // newfocus may be NULL
     if (USE_SCRATCHPAD && showscratchpad && scrpd)
         xcb_raise_window(dis, scrpd->win);
 
+#ifdef EWMH_TASKBAR
+    Update_EWMH_Client_List_Stacking();
+#endif /* EWMH_TASKBAR */
+
     if (check_head(&aliens)) {
         alien *a;
         for (a=(alien *)get_head(&aliens); a; a=(alien *)get_next(&a->link)) {
@@ -3515,7 +4628,12 @@ void update_current(client *newfocus)   // newfocus may be NULL
             xcb_raise_window(dis, a->win);
         }
     }
+    return true;
+}
 
+/* give the input focus to the current client */
+static void focus_current(void)
+{
     if (M_CURRENT) {
         if (M_CURRENT->setfocus) {
             xcb_change_property(dis, XCB_PROP_MODE_REPLACE, screen->root,
@@ -3532,6 +4650,188 @@ void update_current(client *newfocus)   // newfocus may be NULL
     }
 }
 
+void update_current(client *newfocus)   // newfocus may be NULL
+{
+    if (arrange_current(newfocus))
+        focus_current();
+}
+
+/* the monotonic clock in ms */
+static long now_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000L + ts.tv_nsec / 1000000;
+}
+
+/*
+ * the _NET_WM_PID of a window, 0 unless WM_CLIENT_MACHINE is this host.
+ * any client can claim any pid, so init, process groups and the window
+ * manager itself are refused as well.
+ */
+static pid_t client_pid(xcb_window_t win)
+{
+    static char host[256];
+    xcb_get_property_cookie_t pc = xcb_ewmh_get_wm_pid_unchecked(ewmh, win),
+                              mc = xcb_icccm_get_wm_client_machine_unchecked(dis, win);
+    xcb_icccm_get_text_property_reply_t machine;
+    uint32_t pid = 0;
+    bool local = false;
+
+    if (!host[0] && gethostname(host, sizeof(host) - 1) < 0)
+        host[0] = '\0';
+    if (!xcb_ewmh_get_wm_pid_reply(ewmh, pc, &pid, NULL))
+        pid = 0;
+    if (xcb_icccm_get_wm_client_machine_reply(dis, mc, &machine, NULL)) {
+        local = host[0] && machine.name_len == strlen(host)
+                && !strncmp(machine.name, host, machine.name_len);
+        xcb_icccm_get_text_property_reply_wipe(&machine);
+    }
+    if (!local || (pid_t)pid <= 1 || (pid_t)pid == getpid())
+        return 0;
+    return (pid_t)pid;
+}
+
+/*
+ * stop the processes whose windows all spent SUSPEND_DELAY hidden and may be
+ * suspended, by their rule or SUSPEND_DESKTOPS, and continue the others. a
+ * process with a window on the shown desktop, an urgent window, an
+ * unmanaged window or a scratchpad keeps running. windows count as hidden
+ * from the first time this sees them on a hidden desktop. sets
+ * suspend_deadline to when the next process is due, once not running every
+ * process is continued.
+ */
+static void update_suspended(void)
+{
+    static struct { pid_t pid; bool keep, stopped; } *procs;
+    static unsigned int size;
+    unsigned int n = 0;
+    long t = now_ms(), delay = SUSPEND_DELAY * 1000L;
+
+    suspend_stale = false;
+    suspend_deadline = 0;
+
+    for (unsigned int pass = 0; pass < 2; pass++) {
+        for (desktop *desk = (desktop *)get_head(&desktops); desk; desk = (desktop *)get_next(&desk->link))
+        for (monitor *moni = (monitor *)get_head(&desk->monitors); moni; moni = (monitor *)get_next(&moni->link))
+        for (display *disp = (display *)get_head(&moni->displays); disp; disp = (display *)get_next(&disp->link))
+        for (client *c = (client *)get_head(&disp->clients); c; c = M_GETNEXT(c)) {
+            unsigned int i;
+            if (!c->pid)
+                continue;
+            for (i = 0; i < n && procs[i].pid != c->pid; i++) ;
+            if (pass) {     /* the process of each client has been decided */
+                c->isstopped = !procs[i].keep;
+                continue;
+            }
+
+            bool shown = (int)desk->num == shown_desktop;
+            if (shown)
+                c->hiddensince = 0;
+            else if (!c->hiddensince)
+                c->hiddensince = t;
+            bool may = running && !shown && !c->isurgent
+                       && (c->suspend || (SUSPEND_DESKTOPS >> desk->num & 1)),
+                 due = may && t - c->hiddensince >= delay;
+            if (may && !due && (!suspend_deadline || c->hiddensince + delay < suspend_deadline))
+                suspend_deadline = c->hiddensince + delay;
+
+            if (i == n) {
+                if (n == size && !(procs = realloc(procs, (size += 16) * sizeof(*procs))))
+                    err(EXIT_FAILURE, "cannot allocate process list");
+                procs[n].pid = c->pid;
+                procs[n].keep = false;
+                procs[n++].stopped = false;
+                for (unsigned int s = 0; s < LENGTH(scratchpads); s++)
+                    if (scrpds[s] && scrpds[s]->pid == c->pid)
+                        procs[i].keep = true;
+                for (alien *a = (alien *)get_head(&aliens); a; a = (alien *)get_next(&a->link))
+                    if (a->pid == c->pid)   /* it draws on screen */
+                        procs[i].keep = true;
+            }
+            procs[i].keep = procs[i].keep || !due;
+            procs[i].stopped = procs[i].stopped || c->isstopped;
+        }
+        for (unsigned int i = 0; !pass && i < n; i++)
+            if (procs[i].keep == procs[i].stopped) {
+                DEBUGP("%s process %d\n", procs[i].keep ? "continue" : "stop", procs[i].pid);
+                kill(procs[i].pid, procs[i].keep ? SIGCONT : SIGSTOP);
+            }
+    }
+}
+
+/* rebuild the array of tiled clients of a display, if its client list
+ * or the tiling state of one of its clients changed since the last time */
+void update_tiled(display *disp)
+{
+    unsigned int n = 0;
+    client *c;
+
+    if (disp->tiledgen == disp->clients.gen)
+        return;
+
+    for (c = (client *)get_head(&disp->clients); c; c = M_GETNEXT(c))
+        n++;
+    if (n > disp->tiledsize) {
+        client **t = realloc(disp->tiled, n * sizeof(client *));
+        int *b = t ? realloc(disp->borders, n * sizeof(int)) : NULL;
+        rect *r = b ? realloc(disp->rects, n * sizeof(rect)) : NULL;
+        if (!r)
+            err(EXIT_FAILURE, "cannot allocate tiled clients");
+        disp->tiled = t;
+        disp->borders = b;
+        disp->rects = r;
+        disp->tiledsize = n;
+    }
+
+    n = 0;
+    for (c = (client *)get_head(&disp->clients); c; c = M_GETNEXT(c))
+        if (c->istiled)
+            disp->tiled[n++] = c;
+    disp->ntiled = n;
+    disp->tiledgen = disp->clients.gen;
+}
+
+/*
+ * publish _NET_WM_STATE_HIDDEN for the clients nobody can see, so that they
+ * can stop drawing: the ones on other desktops, below a fullscreen display,
+ * minimized, or covered by a maximized window or the top window in monocle
+ * mode. each display is walked top down in the order update_current()
+ * stacks it, current last if it floats, else the client list.
+ * only the clients whose state changed get a property write.
+ */
+static bool stack_visibility(client *c, bool shown, bool monocle, bool covered)
+{
+    bool covering = c->ismaximized || (monocle && c->istiled);
+
+    set_net_wm_state(c, !shown || c->isminimized
+                        || (covered && (c->istiled || c->ismaximized)));
+    return covered || (covering && !c->isminimized);
+}
+
+void update_visibility(void)
+{
+    visibility_stale = false;
+    for (desktop *desk = (desktop *)get_head(&desktops); desk; desk = (desktop *)get_next(&desk->link))
+        for (monitor *moni = (monitor *)get_head(&desk->monitors); moni; moni = (monitor *)get_next(&moni->link))
+            for (display *disp = (display *)get_head(&moni->displays); disp; disp = (display *)get_next(&disp->link)) {
+                bool shown = show && (int)desk->num == shown_desktop
+                             && disp == (display *)get_head(&moni->displays),
+                     monocle = disp->di.mode == MONOCLE, covered = false;
+                client *rl = disp->current;
+
+                if (rl == scrpd || (rl && !(rl->ismaximized || rl->isfloating || rl->istransient
+                            || rl->type != ewmh->_NET_WM_WINDOW_TYPE_NORMAL)))
+                    rl = NULL;
+                if (rl)
+                    covered = stack_visibility(rl, shown, monocle, covered);
+                for (client *c = (client *)get_tail(&disp->clients); c; c = M_GETPREV(c))
+                    if (c != rl)
+                        covered = stack_visibility(c, shown, monocle, covered);
+            }
+}
+
 static alien *wintoalien(list *l, xcb_window_t win)
 {
     alien *t;
@@ -3611,6 +4911,7 @@ int main(int argc, char *argv[])
     }
     if (xcb_connection_has_error((dis = xcb_connect(NULL, &default_screen))))
         errx(EXIT_FAILURE, "error: cannot open display\n");
+    fcntl(xcb_get_file_descriptor(dis), F_SETFD, FD_CLOEXEC);   /* not for spawned commands */
     DEBUG("connected to display");
     if (setup(default_screen) != -1) {
         desktopinfo(); /* zero out every desktop on (re)start */
@@ -3631,7 +4932,7 @@ int main(int argc, char *argv[])
 static void Setup_EWMH_Taskbar_Support(void)
 {
     /*
-     * initial _NET_CLIENT_LIST property
+     * initial _NET_CLIENT_LIST and _NET_CLIENT_LIST_STACKING properties
      */
     Update_EWMH_Taskbar_Properties();
 
@@ -3642,43 +4943,142 @@ static void Setup_EWMH_Taskbar_Support(void)
 static void Cleanup_EWMH_Taskbar_Support(void)
 {
     /*
-     * set _NET_CLIENT_LIST property to zero
+     * set _NET_CLIENT_LIST and _NET_CLIENT_LIST_STACKING properties to zero
      */
     xcb_window_t empty = 0;
     xcb_change_property(dis, XCB_PROP_MODE_REPLACE,
                         screen->root, ewmh->_NET_CLIENT_LIST,
                         XCB_ATOM_WINDOW, 32, 0, &empty);
+    xcb_change_property(dis, XCB_PROP_MODE_REPLACE,
+                        screen->root, ewmh->_NET_CLIENT_LIST_STACKING,
+                        XCB_ATOM_WINDOW, 32, 0, &empty);
+
+    free(clientlist.wins);
+    free(stackinglist.wins);
+    free(stackingscratch.wins);
+}
+
+/* make room for at least n entries, growing geometrically */
+static void winlist_reserve(winlist_t *l, unsigned int n)
+{
+    xcb_window_t *wins;
+    unsigned int size;
+
+    if (n <= l->size)
+        return;
+    for (size = l->size ? l->size : 16; size < n; size *= 2)
+        ;
+    if (!(wins = realloc(l->wins, size * sizeof(xcb_window_t))))
+        err(EXIT_FAILURE, "cannot allocate window list");
+    l->wins = wins;
+    l->size = size;
+}
+
+static inline void winlist_push(winlist_t *l, xcb_window_t win)
+{
+    winlist_reserve(l, l->num + 1);
+    l->wins[l->num++] = win;
+}
+
+/* unlink win from the list, returns false if it was not in there */
+static bool winlist_remove(winlist_t *l, xcb_window_t win)
+{
+    for (unsigned int i = 0; i < l->num; i++) {
+        if (l->wins[i] == win) {
+            memmove(&l->wins[i], &l->wins[i + 1],
+                    (l->num - i - 1) * sizeof(xcb_window_t));
+            l->num--;
+            return true;
+        }
+    }
+    return false;
 }
 
 static inline void Update_EWMH_Taskbar_Properties(void)
 {
     /*
-     * update _NET_CLIENT_LIST property, may be empty
+     * rewrite _NET_CLIENT_LIST and _NET_CLIENT_LIST_STACKING, may be empty
      */
+    xcb_change_property(dis, XCB_PROP_MODE_REPLACE,
+                        screen->root, ewmh->_NET_CLIENT_LIST,
+                        XCB_ATOM_WINDOW, 32, clientlist.num, clientlist.wins);
+    xcb_change_property(dis, XCB_PROP_MODE_REPLACE,
+                        screen->root, ewmh->_NET_CLIENT_LIST_STACKING,
+                        XCB_ATOM_WINDOW, 32, stackinglist.num, stackinglist.wins);
+    DEBUGP("update _NET_CLIENT_LIST property (%d entries)\n", clientlist.num);
+}
 
-    xcb_window_t *wins;
-    client *c;
-    int num=0;
-
-    if(showscratchpad && scrpd)
-        num++;
-    for (c = M_HEAD; c; c = M_GETNEXT(c))
-        num++;
+/*
+ * a new window is managed, _NET_CLIENT_LIST is in initial mapping order
+ * so it is enough to append it to the property
+ */
+static void Add_EWMH_Client(xcb_window_t win)
+{
+    winlist_push(&clientlist, win);
+    xcb_change_property(dis, XCB_PROP_MODE_APPEND,
+                        screen->root, ewmh->_NET_CLIENT_LIST,
+                        XCB_ATOM_WINDOW, 32, 1, &win);
+}
 
-    if((wins = (xcb_window_t *)calloc(num, sizeof(xcb_window_t))))
-    {
-        num = 0;
-        if(showscratchpad && scrpd)
-            wins[num++] = scrpd->win;
-        for (c = M_HEAD; c; c = M_GETNEXT(c))
-            wins[num++] = c->win;
+/* a window is no longer managed, rewrite the lists it was part of */
+static void Remove_EWMH_Client(xcb_window_t win)
+{
+    if (winlist_remove(&clientlist, win))
         xcb_change_property(dis, XCB_PROP_MODE_REPLACE,
                             screen->root, ewmh->_NET_CLIENT_LIST,
-                            XCB_ATOM_WINDOW, 32, num, wins);
-        xcb_flush(dis);
-        free(wins);
-        DEBUGP("update _NET_CLIENT_LIST property (%d entries)\n", num);
+                            XCB_ATOM_WINDOW, 32, clientlist.num, clientlist.wins);
+    if (winlist_remove(&stackinglist, win))
+        xcb_change_property(dis, XCB_PROP_MODE_REPLACE,
+                            screen->root, ewmh->_NET_CLIENT_LIST_STACKING,
+                            XCB_ATOM_WINDOW, 32, stackinglist.num, stackinglist.wins);
+}
+
+/*
+ * rebuild _NET_CLIENT_LIST_STACKING (bottom to top) from our own stacking
+ * model and only touch the property if the order actually changed
+ *
+ * windows of hidden desktops and displays are below everything visible,
+ * the current display is stacked the way update_current() raises it:
+ * tiled clients in list order, then the current window if it is floating,
+ * then the scratchpad
+ */
+static void Update_EWMH_Client_List_Stacking(void)
+{
+    winlist_t *l = &stackingscratch, t;
+    client *rl = NULL;
+
+    l->num = 0;
+    winlist_reserve(l, clientlist.num);
+    for (desktop *desk = (desktop *)get_head(&desktops); desk; desk = (desktop *)get_next(&desk->link))
+        for (monitor *moni = (monitor *)get_head(&desk->monitors); moni; moni = (monitor *)get_next(&moni->link))
+            for (display *disp = (display *)get_head(&moni->displays); disp; disp = (display *)get_next(&disp->link))
+                if (disp != current_display)
+                    for (client *c = (client *)get_head(&disp->clients); c; c = (client *)get_next(&c->link))
+                        winlist_push(l, c->win);
+
+    for (client *c = M_HEAD; c; c = M_GETNEXT(c)) {
+        if (c == M_CURRENT && (c->ismaximized || c->isfloating || c->istransient
+                               || c->type != ewmh->_NET_WM_WINDOW_TYPE_NORMAL))
+            rl = c;
+        else
+            winlist_push(l, c->win);
     }
+    if (rl)
+        winlist_push(l, rl->win);
+    if (USE_SCRATCHPAD && showscratchpad && scrpd)
+        winlist_push(l, scrpd->win);
+
+    if (l->num == stackinglist.num
+     && (!l->num || !memcmp(l->wins, stackinglist.wins, l->num * sizeof(xcb_window_t))))
+        return;
+
+    /* swap buffers, the old one becomes the next scratch space */
+    t = stackinglist;
+    stackinglist = *l;
+    *l = t;
+    xcb_change_property(dis, XCB_PROP_MODE_REPLACE,
+                        screen->root, ewmh->_NET_CLIENT_LIST_STACKING,
+                        XCB_ATOM_WINDOW, 32, stackinglist.num, stackinglist.wins);
 }
 #endif /* EWMH_TASKBAR */
 
@@ -3691,75 +5091,754 @@ static void Setup_Global_Strut(void)
 
 static void Cleanup_Global_Strut(void)
 {
+    free(headstruts);
+    headstruts = NULL;
+    nheadstruts = 0;
 }
 
 static inline void Reset_Global_Strut(void)
 {
-    gstrut.left = gstrut.right = gstrut.top = gstrut.bottom = 0;
-    M_WW = screen->width_in_pixels;
-    M_WH = screen->height_in_pixels;
-    M_WY = 0;
+    for (monitor *moni = (monitor *)get_head(&current_desktop->monitors); moni;
+            moni = (monitor *)get_next(&moni->link))
+        monitor_geometry(moni);
 }
 
-static void Update_Global_Strut(void)
+/* a dock came, went or changed its struts, or the heads changed */
+static inline void Invalidate_Global_Strut(void)
 {
-    /* TODO(?): Struts for each desktop. */
+    strut_stale = true;
+}
 
-    Reset_Global_Strut();
+/*
+ * read the struts of all mapped top level windows into headstruts.
+ * struts are given relative to the screen edges, only the part reaching
+ * into a monitor counts for it. _NET_WM_STRUT_PARTIAL also tells which
+ * columns a top or bottom strut covers, a monitor outside them is spared.
+ */
+static void Read_Global_Strut(void)
+{
+    int sh = screen->height_in_pixels;
+
+    strut_stale = false;
+    if (nheadstruts != nheads) {
+        if (!(headstruts = realloc(headstruts, nheads * sizeof(strut_t))))
+            err(EXIT_FAILURE, "cannot allocate struts");
+        nheadstruts = nheads;
+    }
+    memset(headstruts, 0, nheads * sizeof(strut_t));
 
     /* grab existing windows */
     xcb_query_tree_reply_t *reply = xcb_query_tree_reply(dis,
                                             xcb_query_tree(dis, screen->root), 0);
-    if (reply) {
-        int len = xcb_query_tree_children_length(reply);
-        xcb_window_t *children = xcb_query_tree_children(reply);
-        bool gstrut_modified = False;
-        for (int i = 0; i < len; i++) {
-            xcb_get_window_attributes_reply_t *attr = xcb_get_window_attributes_reply(dis,
-                            xcb_get_window_attributes(dis, children[i]), NULL);
-            if (!attr)
-                continue;
+    if (!reply)
+        return;
+    int len = xcb_query_tree_children_length(reply);
+    xcb_window_t *children = xcb_query_tree_children(reply);
+    for (int i = 0; i < len; i++) {
+        xcb_get_window_attributes_reply_t *attr = xcb_get_window_attributes_reply(dis,
+                        xcb_get_window_attributes(dis, children[i]), NULL);
+        if (!attr)
+            continue;
 
-            if (!(attr->map_state == XCB_MAP_STATE_UNMAPPED)) {
-                void *data;
-                xcb_get_property_reply_t *strut_r;
+        if (!(attr->map_state == XCB_MAP_STATE_UNMAPPED)) {
+            xcb_get_property_reply_t *strut_r;
+            uint32_t strut[12];
+            int n = 0;
 /*
- * Read newer _NET_WM_STRUT_PARTIAL property first. Only the first 4 values.
- * Fall back to older _NET_WM_STRUT property.
+ * Read newer _NET_WM_STRUT_PARTIAL property first, with the ranges of the
+ * struts. Fall back to older _NET_WM_STRUT property, spanning the screen.
  */
+            strut_r = xcb_get_property_reply(dis,
+                      xcb_get_property_unchecked(dis, false, children[i],
+                      ewmh->_NET_WM_STRUT_PARTIAL, XCB_ATOM_CARDINAL, 0, 12), NULL);
+            if (!strut_r || strut_r->value_len < 12) {
+                free(strut_r);
                 strut_r = xcb_get_property_reply(dis,
                           xcb_get_property_unchecked(dis, false, children[i],
-                          ewmh->_NET_WM_STRUT_PARTIAL, XCB_ATOM_CARDINAL, 0, 4), NULL);
-                if (strut_r->type == XCB_NONE) {
-                    strut_r = xcb_get_property_reply(dis,
-                              xcb_get_property_unchecked(dis, false, children[i],
-                              ewmh->_NET_WM_STRUT, XCB_ATOM_CARDINAL, 0, 4), NULL);
+                          ewmh->_NET_WM_STRUT, XCB_ATOM_CARDINAL, 0, 4), NULL);
+            }
+            if (strut_r && strut_r->format == 32 && strut_r->value_len >= 4) {
+                n = strut_r->value_len;
+                memcpy(strut, xcb_get_property_value(strut_r), n * sizeof(uint32_t));
+            }
+            free(strut_r);
+            if (n < 12) {   /* top and bottom span the whole width */
+                strut[8] = strut[10] = 0;
+                strut[9] = strut[11] = screen->width_in_pixels - 1;
+            }
+            for (int m = 0; n && m < nheads; m++) {
+                xcb_rectangle_t *h = &heads[m];
+                strut_t *ms = &headstruts[m];
+                int top = (int)strut[2] - h->y,
+                    bottom = (int)strut[3] - (sh - h->y - h->height);
+                if (top > ms->top && (int)strut[8] < h->x + h->width && (int)strut[9] >= h->x)
+                    ms->top = top;
+                if (bottom > ms->bottom && (int)strut[10] < h->x + h->width && (int)strut[11] >= h->x)
+                    ms->bottom = bottom;
+            }
+        }
+        free(attr);
+    }
+    free(reply);
+}
+
+/*
+ * shrink the monitors of the current desktop by the struts. they are only
+ * read from the X server again once Invalidate_Global_Strut() was called.
+ */
+static void Update_Global_Strut(void)
+{
+    /* TODO(?): Struts for each desktop. */
+    if (strut_stale)
+        Read_Global_Strut();
+    Reset_Global_Strut();
+    for (monitor *moni = (monitor *)get_head(&current_desktop->monitors); moni;
+            moni = (monitor *)get_next(&moni->link)) {
+        if (moni->num >= (unsigned int)nheadstruts)
+            continue;
+        moni->wy += headstruts[moni->num].top;
+        moni->wh -= headstruts[moni->num].top + headstruts[moni->num].bottom;
+    }
+}
+#endif /* EWMH_TASKBAR */
+
+/*
+ * Optional shared memory state snapshot
+ *
+ * The snapshot is guarded by a seqlock: the writer makes seq odd, updates the
+ * data and makes seq even again. Readers copy the data and retry if seq was
+ * odd or changed meanwhile, so they never block the window manager and never
+ * need a syscall as long as nothing changes.
+ */
+
+static void Setup_Shm_State(void)
+{
+    int fd;
+
+    if ((fd = shm_open(SHM_NAME, O_RDWR | O_CREAT, 0600)) < 0) {
+        warn("cannot open shared memory %s", SHM_NAME);
+        return;
+    }
+    if (ftruncate(fd, sizeof(shm_state_t)) < 0
+     || (shmstate = mmap(NULL, sizeof(shm_state_t), PROT_READ | PROT_WRITE,
+                         MAP_SHARED, fd, 0)) == MAP_FAILED) {
+        warn("cannot map shared memory %s", SHM_NAME);
+        shmstate = NULL;
+        shm_unlink(SHM_NAME);
+    }
+    close(fd);
+    if (!shmstate)
+        return;
+
+    /* keep seq, a reader of a previous instance might still wait on it */
+    shmstate->seq |= 1;
+    __sync_synchronize();
+    shmstate->version = SHM_STATE_VERSION;
+    shmstate->size = sizeof(shm_state_t);
+    memset(shmstate->title, 0, sizeof(shmstate->title));
+    memset(shmstate->desktop, 0, sizeof(shmstate->desktop));
+    shmstate->desktops = shmstate->current = shmstate->focused = 0;
+    __sync_synchronize();
+    shmstate->seq++;
+    shmtitlewin = XCB_WINDOW_NONE;
+}
+
+/* wake up everyone waiting for the next snapshot */
+static inline void shm_notify(void)
+{
+#ifdef __linux__
+    syscall(SYS_futex, &shmstate->seq, FUTEX_WAKE, INT32_MAX, NULL, NULL, 0);
+#endif /* __linux__ */
+}
+
+static void Cleanup_Shm_State(void)
+{
+    if (!shmstate)
+        return;
+
+    shmstate->seq++;
+    __sync_synchronize();
+    shmstate->version = 0;
+    __sync_synchronize();
+    shmstate->seq++;
+    shm_notify();
+
+    munmap(shmstate, sizeof(shm_state_t));
+    shmstate = NULL;
+    shm_unlink(SHM_NAME);
+}
+
+static void Update_Shm_State(void)
+{
+    shm_desktop_t info[DESKTOPS];
+    char title[SHM_TITLE_LENGTH];
+    uint32_t n = 0, focused;
+    bool newtitle = false;
+
+    if (!shmstate)
+        return;
+
+    memset(info, 0, sizeof(info));
+    for (n = 0; n < DESKTOPS; n++)
+        info[n].mode = defaultdi.mode;  /* desktops that were not used yet */
+    for (desktop *desk = (desktop *)get_head(&desktops); desk; desk = (desktop *)get_next(&desk->link)) {
+        shm_desktop_t *in = &info[desk->num];
+        monitor *moni = (monitor *)get_head(&desk->monitors);
+        display *disp = moni ? (display *)get_head(&moni->displays) : NULL;
+
+        if (disp)
+            in->mode = disp->di.mode;
+        in->urgent = desk->nurgent;
+        for (; moni; moni = (monitor *)get_next(&moni->link))
+            for (disp = (display *)get_head(&moni->displays); disp; disp = (display *)get_next(&disp->link))
+                for (client *c = (client *)get_head(&disp->clients); c; c = (client *)get_next(&c->link)) {
+                    in->clients++;
+                    in->minimized += c->isminimized;
                 }
-                if(strut_r && strut_r->value_len && (data = xcb_get_property_value(strut_r)))
-                {
-                    uint32_t *strut = data;
-                    if (gstrut.top < strut[2]) {
-                        gstrut.top = strut[2];
-                        gstrut_modified = True;
-                    }
-                    if (gstrut.bottom < strut[3]) {
-                        gstrut.bottom = strut[3];
-                        gstrut_modified = True;
-                    }
+    }
+
+    /* only ask the X server for a title if the focus or the title changed */
+    focused = M_CURRENT ? M_CURRENT->win : XCB_WINDOW_NONE;
+    if (focused != shmtitlewin) {
+        xcb_ewmh_get_utf8_strings_reply_t wname;
+        xcb_icccm_get_text_property_reply_t iname;
+
+        memset(title, 0, sizeof(title));
+        if (focused) {
+            /* ask for both names at once, WM_NAME is used without _NET_WM_NAME */
+            xcb_get_property_cookie_t nc = xcb_ewmh_get_wm_name_unchecked(ewmh, focused),
+                                      ic = xcb_icccm_get_wm_name_unchecked(dis, focused);
+
+            if (xcb_ewmh_get_wm_name_reply(ewmh, nc, &wname, NULL)) {
+                xcb_discard_reply(dis, ic.sequence);
+                memcpy(title, wname.strings, wname.strings_len < sizeof(title) - 1
+                                           ? wname.strings_len : sizeof(title) - 1);
+                xcb_ewmh_get_utf8_strings_reply_wipe(&wname);
+            } else if (xcb_icccm_get_wm_name_reply(dis, ic, &iname, NULL)) {
+                memcpy(title, iname.name, iname.name_len < sizeof(title) - 1
+                                        ? iname.name_len : sizeof(title) - 1);
+                xcb_icccm_get_text_property_reply_wipe(&iname);
+            }
+        }
+        shmtitlewin = focused;
+        newtitle = memcmp(title, shmstate->title, sizeof(title)) != 0;
+    }
+
+    if (!newtitle
+     && shmstate->desktops == n
+     && shmstate->current == (uint32_t)current_desktop_number
+     && shmstate->focused == focused
+     && !memcmp(shmstate->desktop, info, sizeof(info)))
+        return;     /* nothing changed, do not wake up the readers */
+
+    shmstate->seq++;
+    __sync_synchronize();
+    shmstate->desktops = n;
+    shmstate->current = current_desktop_number;
+    shmstate->focused = focused;
+    if (newtitle)
+        memcpy(shmstate->title, title, sizeof(title));
+    memcpy(shmstate->desktop, info, sizeof(info));
+    __sync_synchronize();
+    shmstate->seq++;
+    shm_notify();
+}
+
+/*
+ * Optional IPC socket
+ *
+ * Requests are single lines of text, either the name of an action followed
+ * by its argument, or a query. Every request is answered with zero or more
+ * lines of data followed by a line reading "ok" or "error <reason>".
+ * All sockets are non-blocking and serviced from run(), a client that does
+ * not keep up with reading its responses is disconnected.
+ */
+
+static void Setup_IPC(void)
+{
+    struct sockaddr_un addr;
+    const char *dir = getenv("XDG_RUNTIME_DIR");
+    char *host = NULL;
+    int dpy = 0;
+
+    if (IPC_SOCKET[0] == '/' || !dir || !dir[0])
+        dir = IPC_SOCKET[0] == '/' ? "" : "/tmp";
+    /* one socket per display, an instance on another display keeps its own */
+    if (!xcb_parse_display(NULL, &host, &dpy, NULL))
+        host = NULL;
+    for (char *s = host; s && *s; s++)
+        if (*s == '/')
+            *s = '_';
+    if ((size_t)snprintf(ipcpath, sizeof(ipcpath), "%s%s%s.%s%s%d", dir,
+                         dir[0] ? "/" : "", IPC_SOCKET, host ? host : "",
+                         host && host[0] ? ":" : "", dpy) >= sizeof(ipcpath)) {
+        warnx("IPC socket path too long");
+        free(host);
+        return;
+    }
+    free(host);
+
+    for (unsigned int i = 0; i < IPC_MAX_CLIENTS; i++)
+        ipcclients[i].fd = -1;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path, ipcpath, sizeof(ipcpath));
+
+    if ((ipcfd = socket(AF_UNIX, SOCK_STREAM, 0)) < 0) {
+        warn("cannot create IPC socket");
+        return;
+    }
+    fcntl(ipcfd, F_SETFD, FD_CLOEXEC);
+    fcntl(ipcfd, F_SETFL, O_NONBLOCK);
+    unlink(ipcpath);
+    mode_t mask = umask(0177);  /* created 0600, never open to others */
+    int bound = bind(ipcfd, (struct sockaddr *)&addr, sizeof(addr));
+    umask(mask);
+    if (bound < 0 || listen(ipcfd, IPC_MAX_CLIENTS) < 0) {
+        warn("cannot listen on %s", ipcpath);
+        close(ipcfd);
+        ipcfd = -1;
+        return;
+    }
+    setenv("FRANKENWM_SOCKET", ipcpath, 1);
+}
+
+/* recompute the union of all subscriptions */
+static void ipc_update_subscribed(void)
+{
+    ipcsubscribed = 0;
+    for (unsigned int i = 0; i < IPC_MAX_CLIENTS; i++)
+        if (ipcclients[i].fd >= 0)
+            ipcsubscribed |= ipcclients[i].events;
+}
+
+static void ipc_close(ipcclient *ic)
+{
+    bool subscriber = ic->events != 0;
+
+    close(ic->fd);
+    free(ic->out);
+    memset(ic, 0, sizeof(ipcclient));
+    ic->fd = -1;
+    if (subscriber)
+        ipc_update_subscribed();
+}
+
+static void Cleanup_IPC(void)
+{
+    if (ipcfd < 0)
+        return;
+    for (unsigned int i = 0; i < IPC_MAX_CLIENTS; i++)
+        if (ipcclients[i].fd >= 0)
+            ipc_close(&ipcclients[i]);
+    close(ipcfd);
+    ipcfd = -1;
+    unlink(ipcpath);
+}
+
+/* queue formatted output for a client, it is written once the socket allows */
+static void ipc_printf(ipcclient *ic, const char *fmt, ...)
+{
+    va_list ap;
+    int n;
+
+    if (ic->fd < 0)
+        return;
+    for (;;) {
+        va_start(ap, fmt);
+        n = vsnprintf(ic->out + ic->outlen, ic->outsize - ic->outlen, fmt, ap);
+        va_end(ap);
+        if (n < 0)
+            return;
+        if (ic->outlen + n < ic->outsize)
+            break;
+        if (ic->outlen + n >= IPC_MAX_OUTPUT) {
+            ipc_close(ic);      /* not reading, give up on it */
+            return;
+        }
+
+        unsigned int size = ic->outsize ? ic->outsize : 4096;
+        char *out;
+        while (size <= ic->outlen + n)
+            size *= 2;
+        if (!(out = realloc(ic->out, size))) {
+            ipc_close(ic);
+            return;
+        }
+        ic->out = out;
+        ic->outsize = size;
+    }
+    ic->outlen += n;
+}
+
+/*
+ * move queued events into the output buffer, but only as much as fits in a
+ * line buffer, so events keep collapsing while the subscriber is busy
+ */
+static void ipc_pump(ipcclient *ic)
+{
+    while (ic->fd >= 0 && ic->qlen && ic->outlen < IPC_LINE_LENGTH) {
+        ipcevent *ev = &ic->queue[ic->qhead];
+
+        switch (ev->type) {
+            case IPC_EV_FOCUS:
+            case IPC_EV_UNMANAGE:
+                ipc_printf(ic, "event %s 0x%08x\n", ipceventnames[ev->type], ev->a);
+                break;
+            case IPC_EV_MANAGE:
+            case IPC_EV_URGENCY:
+                ipc_printf(ic, "event %s 0x%08x %u\n", ipceventnames[ev->type], ev->a, ev->b);
+                break;
+            case IPC_EV_DESKTOP:
+                ipc_printf(ic, "event %s %u\n", ipceventnames[ev->type], ev->a);
+                break;
+            case IPC_EV_MODE:
+                ipc_printf(ic, "event %s %u %u\n", ipceventnames[ev->type], ev->a, ev->b);
+                break;
+        }
+        ic->qhead = (ic->qhead + 1) % IPC_EVENT_QUEUE;
+        ic->qlen--;
+    }
+    if (ic->fd >= 0 && !ic->qlen && ic->overflow && ic->outlen < IPC_LINE_LENGTH) {
+        ipc_printf(ic, "event overflow\n");    /* subscriber should resync */
+        ic->overflow = false;
+    }
+}
+
+/* write as much pending output as the socket takes without blocking */
+static void ipc_flush(ipcclient *ic)
+{
+    ssize_t n;
+
+    ipc_pump(ic);
+    while (ic->fd >= 0 && ic->outlen) {
+        if ((n = send(ic->fd, ic->out, ic->outlen, MSG_NOSIGNAL)) < 0) {
+            if (errno == EINTR)
+                continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK)
+                ipc_close(ic);
+            return;
+        }
+        memmove(ic->out, ic->out + n, ic->outlen - n);
+        ic->outlen -= n;
+        ipc_pump(ic);
+    }
+}
+
+/*
+ * queue an event for every subscriber
+ *
+ * focus, desktop and mode events describe a state, so an older event of the
+ * same kind still waiting in the queue is superseded by the new one. if the
+ * queue is full anyway the event is dropped and the subscriber is told so
+ * once it caught up.
+ */
+static void Emit_IPC_Event(int type, uint32_t a, uint32_t b)
+{
+    if (!(ipcsubscribed & (1 << type)))
+        return;
+
+    for (unsigned int i = 0; i < IPC_MAX_CLIENTS; i++) {
+        ipcclient *ic = &ipcclients[i];
+
+        if (ic->fd < 0 || !(ic->events & (1 << type)))
+            continue;
+
+        if (type == IPC_EV_FOCUS || type == IPC_EV_DESKTOP || type == IPC_EV_MODE) {
+            for (unsigned int j = 0; j < ic->qlen; j++) {
+                unsigned int k = (ic->qhead + j) % IPC_EVENT_QUEUE;
+                if (ic->queue[k].type != type
+                 || (type == IPC_EV_MODE && ic->queue[k].a != a))
+                    continue;
+                /* close the gap, the newer event goes to the tail */
+                for (; j + 1 < ic->qlen; j++) {
+                    unsigned int n = (ic->qhead + j + 1) % IPC_EVENT_QUEUE;
+                    ic->queue[(ic->qhead + j) % IPC_EVENT_QUEUE] = ic->queue[n];
                 }
+                ic->qlen--;
+                break;
             }
-            free(attr);
         }
-        free(reply);
-        if (gstrut_modified) {
-            M_WW = screen->width_in_pixels;
-            M_WH = screen->height_in_pixels;
-            M_WH -= gstrut.top;
-            M_WH -= gstrut.bottom;
-            M_WY = gstrut.top;
+
+        if (ic->qlen == IPC_EVENT_QUEUE) {
+            ic->overflow = true;
+            continue;
         }
+        ic->queue[(ic->qhead + ic->qlen) % IPC_EVENT_QUEUE] = (ipcevent){ type, a, b };
+        ic->qlen++;
     }
 }
-#endif /* EWMH_TASKBAR */
+
+/* subscribe to a space separated list of event names, or "all" */
+static void ipc_subscribe(ipcclient *ic, char *names)
+{
+    unsigned int events = 0;
+
+    for (char *name = strtok(names, " \t"); name; name = strtok(NULL, " \t")) {
+        unsigned int i;
+
+        if (!strcmp(name, "all")) {
+            events = (1 << IPC_EVENTS) - 1;
+            continue;
+        }
+        for (i = 0; i < IPC_EVENTS && strcmp(name, ipceventnames[i]); i++)
+            ;
+        if (i == IPC_EVENTS) {
+            ipc_printf(ic, "error unknown event %s\n", name);
+            return;
+        }
+        events |= 1 << i;
+    }
+    if (!events) {
+        ipc_printf(ic, "error no events\n");
+        return;
+    }
+    ic->events |= events;
+    ipc_update_subscribed();
+    ipc_printf(ic, "ok\n");
+}
+
+static void ipc_query_desktops(ipcclient *ic)
+{
+    for (desktop *desk = (desktop *)get_head(&desktops); desk; desk = (desktop *)get_next(&desk->link)) {
+        monitor *moni = (monitor *)get_head(&desk->monitors);
+        display *disp = (display *)get_head(&moni->displays);
+        int n = 0, minimized = 0;
+
+        for (; moni; moni = (monitor *)get_next(&moni->link))
+            for (display *d = (display *)get_head(&moni->displays); d; d = (display *)get_next(&d->link))
+                for (client *c = (client *)get_head(&d->clients); c; c = (client *)get_next(&c->link)) {
+                    n++;
+                    minimized += c->isminimized;
+                }
+        ipc_printf(ic, "%u %d %d %d %u %d\n", desk->num, n, disp->di.mode,
+                   desk == current_desktop, desk->nurgent, minimized);
+    }
+}
+
+static void ipc_query_monitors(ipcclient *ic)
+{
+    for (desktop *desk = (desktop *)get_head(&desktops); desk; desk = (desktop *)get_next(&desk->link))
+        for (monitor *moni = (monitor *)get_head(&desk->monitors); moni; moni = (monitor *)get_next(&moni->link))
+            ipc_printf(ic, "%u %u %d %d %d %d\n", desk->num, moni->num,
+                       moni->wx, moni->wy, moni->ww, moni->wh);
+}
+
+/*
+ * one line per client with its geometry, the geometry requests are all sent
+ * before the first reply is read so this costs a single round trip
+ */
+static void ipc_query_clients(ipcclient *ic)
+{
+    unsigned int n = 0, i = 0;
+
+    for (desktop *desk = (desktop *)get_head(&desktops); desk; desk = (desktop *)get_next(&desk->link))
+        for (monitor *moni = (monitor *)get_head(&desk->monitors); moni; moni = (monitor *)get_next(&moni->link))
+            for (display *disp = (display *)get_head(&moni->displays); disp; disp = (display *)get_next(&disp->link))
+                for (client *c = (client *)get_head(&disp->clients); c; c = (client *)get_next(&c->link))
+                    n++;
+    if (!n)
+        return;
+
+    xcb_get_geometry_cookie_t *cookies = calloc(n, sizeof(xcb_get_geometry_cookie_t));
+    if (!cookies)
+        return;
+
+    for (desktop *desk = (desktop *)get_head(&desktops); desk; desk = (desktop *)get_next(&desk->link))
+        for (monitor *moni = (monitor *)get_head(&desk->monitors); moni; moni = (monitor *)get_next(&moni->link))
+            for (display *disp = (display *)get_head(&moni->displays); disp; disp = (display *)get_next(&disp->link))
+                for (client *c = (client *)get_head(&disp->clients); c; c = (client *)get_next(&c->link))
+                    cookies[i++] = xcb_get_geometry(dis, c->win);
+
+    i = 0;
+    for (desktop *desk = (desktop *)get_head(&desktops); desk; desk = (desktop *)get_next(&desk->link))
+        for (monitor *moni = (monitor *)get_head(&desk->monitors); moni; moni = (monitor *)get_next(&moni->link))
+            for (display *disp = (display *)get_head(&moni->displays); disp; disp = (display *)get_next(&disp->link))
+                for (client *c = (client *)get_head(&disp->clients); c; c = (client *)get_next(&c->link)) {
+                    xcb_get_geometry_reply_t *g = xcb_get_geometry_reply(dis, cookies[i++], NULL);
+
+                    if (!g)
+                        continue;
+                    ipc_printf(ic, "0x%08x %u %d %d %d %d %d %s%s%s%s%s%s%s-\n",
+                               c->win, desk->num, g->x, g->y, g->width, g->height,
+                               g->border_width,
+                               c == disp->current ? "c" : "",
+                               c->isfloating ? "f" : "",
+                               c->isfullscreen ? "F" : "",
+                               c->ismaximized ? "M" : "",
+                               c->isminimized ? "m" : "",
+                               c->istransient ? "t" : "",
+                               c->isurgent ? "u" : "");
+                    free(g);
+                }
+    free(cookies);
+}
+
+/* parse and execute a single request line */
+static void ipc_request(ipcclient *ic, char *line)
+{
+    char *name, *argstr, *end;
+    long v = 0;
+
+    for (name = line; *name == ' ' || *name == '\t'; name++)
+        ;
+    for (argstr = name; *argstr && *argstr != ' ' && *argstr != '\t'; argstr++)
+        ;
+    if (*argstr)
+        *argstr++ = '\0';
+    while (*argstr == ' ' || *argstr == '\t')
+        argstr++;
+
+    if (!*name)
+        return;
+
+    if (!strcmp(name, "subscribe")) {
+        ipc_subscribe(ic, argstr);
+        return;
+    }
+
+    if (!strcmp(name, "query")) {
+        if (!strcmp(argstr, "desktops"))
+            ipc_query_desktops(ic);
+        else if (!strcmp(argstr, "clients"))
+            ipc_query_clients(ic);
+        else if (!strcmp(argstr, "monitors"))
+            ipc_query_monitors(ic);
+        else {
+            ipc_printf(ic, "error unknown query\n");
+            return;
+        }
+        ipc_printf(ic, "ok\n");
+        return;
+    }
+
+    for (unsigned int i = 0; i < LENGTH(ipccommands); i++) {
+        const ipccommand *cmd = &ipccommands[i];
+
+        if (strcmp(name, cmd->name))
+            continue;
+
+        if (cmd->argtype == IPC_COMMAND) {
+            if (!*argstr) {
+                ipc_printf(ic, "error missing command\n");
+                return;
+            }
+            cmd->func(&(Arg){.com = (const char*[]){"/bin/sh", "-c", argstr, NULL}});
+        }
+        else {
+            if (cmd->argtype != IPC_NOARG) {
+                errno = 0;
+                v = strtol(argstr, &end, 0);
+                if (!*argstr || *end || errno
+                 || (cmd->argtype == IPC_DESKTOP && (v < 0 || v >= DESKTOPS))
+                 || (cmd->argtype == IPC_MODE && (v < 0 || v >= MODES))) {
+                    ipc_printf(ic, "error invalid argument\n");
+                    return;
+                }
+            }
+            cmd->func(&(Arg){.i = v});
+        }
+        ipc_printf(ic, "ok\n");
+        return;
+    }
+    ipc_printf(ic, "error unknown command\n");
+}
+
+/* read whatever is available and handle all complete lines */
+static void ipc_read(ipcclient *ic)
+{
+    ssize_t n;
+
+    for (;;) {
+        n = read(ic->fd, ic->in + ic->inlen, sizeof(ic->in) - ic->inlen);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+            return;
+        if (n <= 0) {
+            ipc_close(ic);
+            return;
+        }
+        ic->inlen += n;
+
+        char *line = ic->in, *nl;
+        while (ic->fd >= 0 && (nl = memchr(line, '\n', ic->inlen - (line - ic->in)))) {
+            *nl = '\0';
+            ipc_request(ic, line);
+            line = nl + 1;
+        }
+        if (ic->fd < 0 || !running)
+            return;
+        ic->inlen -= line - ic->in;
+        memmove(ic->in, line, ic->inlen);
+        if (ic->inlen == sizeof(ic->in)) {
+            ipc_close(ic);      /* line too long */
+            return;
+        }
+    }
+}
+
+static void ipc_accept(void)
+{
+    int fd;
+
+    while ((fd = accept(ipcfd, NULL, NULL)) >= 0) {
+        unsigned int i;
+
+        for (i = 0; i < IPC_MAX_CLIENTS && ipcclients[i].fd >= 0; i++)
+            ;
+        if (i == IPC_MAX_CLIENTS) {
+            close(fd);
+            continue;
+        }
+        fcntl(fd, F_SETFD, FD_CLOEXEC);
+        fcntl(fd, F_SETFL, O_NONBLOCK);
+        ipcclients[i].fd = fd;
+    }
+}
+
+/*
+ * wait until either the X connection or one of the IPC sockets becomes ready
+ * or timeout ms passed, -1 waits forever. the sockets are serviced, X events
+ * are left to run()
+ */
+static void Wait_IPC(int timeout)
+{
+    struct pollfd fds[IPC_MAX_CLIENTS + 2];
+    ipcclient *owner[IPC_MAX_CLIENTS + 2];
+    unsigned int n = 0;
+
+    fds[n].fd = xcb_get_file_descriptor(dis);
+    fds[n].events = POLLIN;
+    owner[n++] = NULL;
+    fds[n].fd = ipcfd;
+    fds[n].events = POLLIN;
+    owner[n++] = NULL;
+    for (unsigned int i = 0; i < IPC_MAX_CLIENTS; i++) {
+        if (ipcclients[i].fd < 0)
+            continue;
+        fds[n].fd = ipcclients[i].fd;
+        fds[n].events = POLLIN | (ipcclients[i].outlen || ipcclients[i].qlen
+                                  || ipcclients[i].overflow ? POLLOUT : 0);
+        owner[n++] = &ipcclients[i];
+    }
+
+    if (poll(fds, n, timeout) <= 0)
+        return;
+
+    for (unsigned int i = 2; i < n && running; i++) {
+        if (owner[i]->fd != fds[i].fd)
+            continue;
+        if (fds[i].revents & POLLOUT)
+            ipc_flush(owner[i]);
+        if (fds[i].revents & (POLLIN | POLLHUP | POLLERR))
+            ipc_read(owner[i]);
+    }
+    if (fds[1].revents & POLLIN)
+        ipc_accept();
+    for (unsigned int i = 0; i < IPC_MAX_CLIENTS; i++)
+        ipc_flush(&ipcclients[i]);
+}
 
 /* vim: set ts=4 sw=4 expandtab :*/
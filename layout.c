@@ -0,0 +1,318 @@
+/* see license for copyright and license */
+
+#include <stdbool.h>
+#include "layout.h"
+
+static inline void place(const layoutparams *p, rect *r, int x, int y, int w, int h)
+{
+    r->x = p->x + x;
+    r->y = y;
+    r->w = w;
+    r->h = h;
+}
+
+int layout_params_equal(const layoutparams *a, const layoutparams *b)
+{
+    return a->ww == b->ww && a->wh == b->wh && a->h == b->h && a->x == b->x && a->y == b->y
+        && a->gaps == b->gaps && a->growth == b->growth && a->invert == b->invert
+        && a->mratio == b->mratio && a->msize == b->msize && a->minwsz == b->minwsz
+        && a->headborder == b->headborder && a->headtiled == b->headtiled
+        && a->monoborder == b->monoborder;
+}
+
+/*
+ * windows are only ever shrunk, never grown over their neighbours, so a
+ * minimum size larger than the place is not met. it wins over the
+ * increments otherwise.
+ */
+void layout_hints(const sizehints *h, rect *r, int center)
+{
+    int w = r->w, hh = r->h;
+
+    if (h->incw > 0 && w > h->basew)
+        w -= (w - h->basew) % h->incw;
+    if (h->inch > 0 && hh > h->baseh)
+        hh -= (hh - h->baseh) % h->inch;
+    if (h->maxw > 0 && w > h->maxw)
+        w = h->maxw;
+    if (h->maxh > 0 && hh > h->maxh)
+        hh = h->maxh;
+    if (w < h->minw)
+        w = r->w < h->minw ? r->w : h->minw;
+    if (hh < h->minh)
+        hh = r->h < h->minh ? r->h : h->minh;
+
+    if (center) {
+        r->x += (r->w - w) / 2;
+        r->y += (r->h - hh) / 2;
+    }
+    r->w = w;
+    r->h = hh;
+}
+
+/* dualstack layout (three-column-layout, tcl in dwm) */
+void layout_dualstack(const layoutparams *p, int count, const int *borders, rect *r)
+{
+    int n = count - 1, hh = p->h, cy = p->y, z = hh, l = 0, rn = 0,
+        ma = (p->invert ? p->wh : p->ww) * p->mratio + p->msize;
+
+    l = (n - 1) / 2 + 1; /* left stack size */
+    rn = n - l;          /* right stack size */
+
+    if (!count) {
+        return;
+    } else if (!n) {
+        place(p, r, p->gaps, cy + p->gaps,
+              p->ww - 2 * (borders[0] + p->gaps),
+              hh - 2 * (borders[0] + p->gaps));
+        return;
+    }
+
+    /* tile the first window to cover the master area */
+    int b = borders[0];
+    if (p->invert)
+        place(p, r, p->gaps,
+              cy + (hh - ma) / 2 + p->gaps,
+              p->ww - 2 * (b + p->gaps),
+              n > 1 ? ma - 2 * p->gaps - 2 * b
+                    : ma + (hh - ma) / 2 - 2 * b - 2 * p->gaps);
+    else
+        place(p, r, (p->ww - ma) / 2 + b + p->gaps,
+              cy + p->gaps,
+              n > 1 ? (ma - 4 * b - 2 * p->gaps)
+                    : (ma + (p->ww - ma) / 2 - 3 * b - 2 * p->gaps),
+              hh - 2 * (b + p->gaps));
+
+    int cw = (p->ww - ma) / 2 - b - p->gaps,
+        ch = z;
+        cy += p->gaps;
+
+    /*
+     * tile the stack windows in a single pass, first the left (top) stack
+     * and then the right (bottom) one, each split into equal rows (columns)
+     */
+    for (int s = 0, d = 1; s < 2; s++) {
+        int cnt = s ? rn : l, last = d + cnt;
+        if (!cnt)
+            break;
+        int split = (p->invert ? p->ww - p->gaps : ch - p->gaps) / cnt,
+            pos = p->invert ? p->gaps : cy,
+            sy = s ? cy + (hh - ma) / 2 + ma - p->gaps : cy,
+            sh = (hh - ma) / 2 - p->gaps;
+
+        for (; d < last; d++, pos += split) {
+            int b = borders[d];
+            if (p->invert)
+                place(p, &r[d], pos, sy, split - 2 * b - p->gaps, sh - 2 * b);
+            else
+                place(p, &r[d], s ? p->ww - cw - 2 * b - p->gaps : p->gaps, pos,
+                      cw, split - 2 * b - p->gaps);
+        }
+    }
+}
+
+/*
+ * equal mode
+ * tile the windows in rows or columns, givin each window an equal amount of
+ * screen space
+ * will use rows when inverted and columns otherwise
+ */
+void layout_equal(const layoutparams *p, int n, const int *borders, rect *r)
+{
+    for (int j = 0; j < n; j++) {
+        int b = borders[j];
+        bool head = !j && p->headtiled;
+        if (p->invert)
+            place(p, &r[j], p->gaps,
+                  p->y + p->h / n * j + (head ? p->gaps : 0),
+                  p->ww - 2 * b - 2 * p->gaps,
+                  p->h / n - 2 * b - (head ? 2 : 1) * p->gaps);
+        else
+            place(p, &r[j], p->ww / n * j + (head ? p->gaps : 0),
+                  p->y + p->gaps,
+                  p->ww / n - 2 * b - (head ? 2 : 1) * p->gaps,
+                  p->h - 2 * b - 2 * p->gaps);
+    }
+}
+
+/*
+ * fibonacci mode / fibonacci layout
+ * tile the windows based on the fibonacci series pattern.
+ * arrange windows in such a way that every new window shares
+ * half the space of the space taken by the last window
+ * inverting changes between right/down and right/up
+ */
+void layout_fibonacci(const layoutparams *p, int count, const int *borders, rect *r)
+{
+    int x = p->gaps, y = p->y, tt = 0,
+        cw = p->ww - 2 * p->gaps - 2 * p->headborder,
+        ch = p->h - 2 * p->gaps - 2 * p->headborder;
+
+    /* a single pass, j is the position in the stack */
+    for (int j = 0; j < count; j++) {
+        bool n = j + 1 < count;     /* another tiled window follows */
+        int b = borders[j];
+
+        /*
+         * not the last window in stack ? -> half the client size, and also
+         * check if we have too many windows to keep them larger than minwsz
+         */
+        if (n
+            && ch > p->minwsz * 2 + b + p->gaps
+            && cw > p->minwsz * 2 + b + p->gaps) {
+            (j & 1) ? (ch = ch / 2 - b - p->gaps / 2)
+                    : (cw = cw / 2 - b - p->gaps / 2);
+            tt = j;
+        }
+
+        /* not the master client ? -> shift client right or down (or up) */
+        if (j) {
+            (j & 1) ? (x = x + cw + 2 * b + p->gaps)
+                    : (y = p->invert ? (y - ch - 2 * b - p->gaps)
+                                     : (y + ch + 2 * b + p->gaps));
+
+            if (j & 1 && n && p->invert)
+                y += ch + 2 * b + p->gaps;
+        }
+
+        /* if the window does not fit in the stack, do not jam it in there */
+        if (j <= tt + 1)
+            place(p, &r[j], x, y + p->gaps, cw, ch);
+        else
+            r[j].x = LAYOUT_UNPLACED;
+    }
+}
+
+/* arrange windows in a grid */
+void layout_grid(const layoutparams *p, int n, const int *borders, rect *r)
+{
+    int cols = 0, cn = 0, rn = 0;
+
+    if (!n)
+        return;
+    for (cols = 0; cols <= n / 2; cols++)
+        if (cols * cols >= n)
+            break; /* emulate square root */
+    if (n == 5)
+        cols = 2;
+
+    int rows = n / cols,
+        ch = p->h - p->gaps,
+        cw = (p->ww - p->gaps) / (cols ? cols : 1);
+    for (int i = 0; i < n; i++) {
+        int b = borders[i];
+        if (i / rows + 1 > cols - n % cols)
+            rows = n / cols + 1;
+        place(p, &r[i], cn * cw + p->gaps,
+              p->y + rn * ch / rows + p->gaps,
+              cw - 2 * b - p->gaps,
+              ch / rows - 2 * b - p->gaps);
+        if (++rn >= rows) {
+            rn = 0;
+            cn++;
+        }
+    }
+}
+
+/* each window should cover all the available screen space */
+void layout_monocle(const layoutparams *p, int n, const int *borders, rect *r)
+{
+    (void)borders;
+    for (int i = 0; i < n; i++)
+        place(p, &r[i], p->gaps, p->y + p->gaps,
+              p->ww - 2 * p->gaps - p->monoborder, p->h - 2 * p->gaps - p->monoborder);
+}
+
+/*
+ * arrange windows in normal or bottom stack tile
+ *
+ * if there is only one window, it should cover the available screen space
+ * if there is only one stack window (n == 1) then we don't care about
+ * growth if more than one stack windows (n > 1) on screen then adjustments
+ * may be needed
+ *   - d is the num of pixels than remain when spliting
+ *   the available width/height to the number of windows
+ *   - z is the clients' height/width
+ *
+ *      ----------  -.    --------------------.
+ *      |   |----| --|--> growth               `}--> first client will get
+ *      |   |    |   |                          |    (z+d) height/width
+ *      |   |----|   }--> screen height - hh  --'
+ *      |   |    | }-|--> client height - z
+ *      ----------  -'
+ *
+ *     ->  piece of art by c00kiemon5ter o.O om nom nom nom nom
+ *
+ *     what we do is, remove the growth from the screen height   : (z -
+ *     growth) and then divide that space with the windows on the stack  :
+ *     (z - growth)/n so all windows have equal height/width (z)
+ *     : growth is left out and will later be added to the first's client
+ *     height/width before that, there will be cases when the num of
+ *     windows is not perfectly divided with then available screen
+ *     height/width (ie 100px scr. height, and 3 windows) so we get that
+ *     remaining space and merge growth to it (d) : (z - growth) % n +
+ *     growth finally we know each client's height, and how many pixels
+ *     should be added to the first stack window so that it satisfies
+ *     growth, and doesn't create gaps
+ *     on the bottom of the screen.
+ */
+static void stack(const layoutparams *p, int count, const int *borders, rect *r, bool b)
+{
+    int n = count - 1, d = 0, hh = p->h, cy = p->y, z = b ? p->ww : hh,
+        ma = (b ? p->wh : p->ww) * p->mratio + p->msize;
+
+    if (!count) {
+        return;
+    } else if (!n) {
+        place(p, r, p->gaps, cy + p->gaps,
+              p->ww - 2 * (borders[0] + p->gaps),
+              hh - 2 * (borders[0] + p->gaps));
+        return;
+    } else if (n > 1) {
+        d = (z - p->growth) % n + p->growth; z = (z - p->growth) / n;
+    }
+
+    /* tile the first window to cover the master area */
+    int bw = borders[0];
+    if (b)
+        place(p, r, p->gaps,
+              p->invert ? (cy + hh - ma + p->gaps) : (cy + p->gaps),
+              p->ww - 2 * (bw + p->gaps),
+              ma - 2 * (bw + p->gaps));
+    else
+        place(p, r, p->invert ? (p->ww - ma + p->gaps) : p->gaps,
+              cy + p->gaps,
+              ma - 2 * (bw + p->gaps),
+              hh - 2 * (bw + p->gaps));
+
+    /* tile the next (first) stack window with growth|d */
+    bw = borders[1];
+    int cx = b ? 0 : (p->invert ? p->gaps : ma),
+        cw = (b ? hh : p->ww) - 2 * bw - ma - p->gaps,
+        ch = z - 2 * bw - p->gaps;
+    if (b)
+        place(p, &r[1], cx += p->gaps, cy += p->invert ? p->gaps : ma,
+              ch - p->gaps + d, cw);
+    else
+        place(p, &r[1], cx, cy += p->gaps, cw, ch - p->gaps + d);
+
+    /* tile the rest of the stack windows */
+    b ? (cx += z + d - p->gaps) : (cy += z + d - p->gaps);
+    for (int i = 2; i <= n; i++) {
+        if (b) {
+            place(p, &r[i], cx, cy, ch, cw); cx += z;
+        } else {
+            place(p, &r[i], cx, cy, cw, ch); cy += z;
+        }
+    }
+}
+
+void layout_stack(const layoutparams *p, int n, const int *borders, rect *r)
+{
+    stack(p, n, borders, r, false);
+}
+
+void layout_bstack(const layoutparams *p, int n, const int *borders, rect *r)
+{
+    stack(p, n, borders, r, true);
+}
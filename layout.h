@@ -0,0 +1,74 @@
+/* see license for copyright and license */
+
+#ifndef LAYOUT_H
+#define LAYOUT_H
+
+#include <limits.h>
+
+/*
+ * layout kernels compute the geometry of the tiled windows of a display.
+ * they know nothing about X or the window manager's state, the caller
+ * passes in the work area and settings and applies the resulting rects.
+ */
+
+/* the parameters of a layout pass
+ * ww, wh       - width and height of the monitor's work area
+ * x            - left edge of the work area, added to every window's x
+ * h, y         - height available to the windows and their offset from top
+ * gaps         - size of the useless gap
+ * growth       - growth factor of the first stack window
+ * invert       - use the alternate version of the layout
+ * mratio       - the master-stack ratio
+ * msize        - pixels added to the master area
+ * minwsz       - minimum window size
+ * headborder   - border width of the display's first client, tiled or not
+ * headtiled    - the first tiled window is the display's first client
+ * monoborder   - space taken by the borders of each window in monocle mode
+ */
+typedef struct {
+    int ww, wh, x, h, y;
+    int gaps, growth;
+    int invert;
+    double mratio;
+    float msize;
+    int minwsz;
+    int headborder, headtiled, monoborder;
+} layoutparams;
+
+/* the geometry of a window, windows the layout has no room for are
+ * left where they are and get x set to LAYOUT_UNPLACED */
+typedef struct {
+    int x, y, w, h;
+} rect;
+#define LAYOUT_UNPLACED INT_MIN
+
+/* the sizes a window accepts, from its WM_NORMAL_HINTS, 0 where unset
+ * basew, baseh - the size the increments count from
+ * incw, inch   - the steps the size changes in
+ * minw, minh   - the minimum size
+ * maxw, maxh   - the maximum size
+ */
+typedef struct {
+    int basew, baseh, incw, inch, minw, minh, maxw, maxh;
+} sizehints;
+
+/* a kernel places n tiled windows, given their border widths,
+ * by filling one rect per window */
+typedef void (*layoutkernel)(const layoutparams *p, int n, const int *borders, rect *r);
+
+/* true if two parameter blocks lead to the same layout */
+int layout_params_equal(const layoutparams *a, const layoutparams *b);
+
+/* shrink a placed window to the largest size its hints accept, the space
+ * given up stays right and below it, or around it if center is set */
+void layout_hints(const sizehints *h, rect *r, int center);
+
+void layout_stack(const layoutparams *p, int n, const int *borders, rect *r);
+void layout_bstack(const layoutparams *p, int n, const int *borders, rect *r);
+void layout_grid(const layoutparams *p, int n, const int *borders, rect *r);
+void layout_monocle(const layoutparams *p, int n, const int *borders, rect *r);
+void layout_fibonacci(const layoutparams *p, int n, const int *borders, rect *r);
+void layout_dualstack(const layoutparams *p, int n, const int *borders, rect *r);
+void layout_equal(const layoutparams *p, int n, const int *borders, rect *r);
+
+#endif /* LAYOUT_H */
@@ -0,0 +1,161 @@
+/* see license for copyright and license */
+
+/*
+ * headless benchmark of the layout kernels, run with make bench
+ *
+ * every layout places 1 to 10000 windows on a 1920x1080 work area, both
+ * plain and inverted. the time per window and a checksum of the computed
+ * rects are reported, so changes to a kernel can be checked for speed and
+ * for unchanged output.
+ *
+ * with -c only the checksums are printed, of the same passes on a work
+ * area at x 0 and at x 1920, and of layout_hints() applied to the tile
+ * layout with several size hints. make check compares them to
+ * layoutbench.sum and fails on any difference.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "layout.h"
+
+#define MAXWIN      10000
+#define MINWORK     2000000     /* windows to place per measurement */
+
+static const struct {
+    const char *name;
+    layoutkernel kernel;
+} kernels[] = {
+    { "tile",      layout_stack },
+    { "bstack",    layout_bstack },
+    { "grid",      layout_grid },
+    { "monocle",   layout_monocle },
+    { "fibonacci", layout_fibonacci },
+    { "dualstack", layout_dualstack },
+    { "equal",     layout_equal },
+};
+
+static const int sizes[] = { 1, 2, 3, 5, 10, 100, 1000, 10000 };
+static const int offsets[] = { 0, 1920 };      /* x of the work area */
+
+/* size hints of the hints checks, the first one leaves the rects alone */
+static const sizehints hints[] = {
+    { 0, 0, 0, 0, 0, 0, 0, 0 },
+    { 2, 4, 7, 13, 0, 0, 0, 0 },                /* terminal like increments */
+    { 0, 0, 0, 0, 300, 200, 0, 0 },             /* minimum size */
+    { 0, 0, 0, 0, 0, 0, 640, 480 },             /* maximum size */
+    { 10, 10, 9, 17, 400, 300, 1000, 700 },     /* all of them */
+};
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* fnv-1a over the rects, unplaced windows included */
+static uint32_t checksum(const rect *r, int n)
+{
+    uint32_t h = 2166136261u;
+
+    for (int i = 0; i < n; i++) {
+        const int v[4] = { r[i].x, r[i].y, r[i].w, r[i].h };
+        for (int k = 0; k < 4; k++) {
+            h ^= (uint32_t)v[k];
+            h *= 16777619u;
+        }
+    }
+    return h;
+}
+
+/*
+ * print the checksums of every layout and of layout_hints(), a work area
+ * moved right must move every rect by as much. returns the number of
+ * passes for which it did not.
+ */
+static int check(layoutparams *p, const int *borders, rect *rects)
+{
+    static rect base[MAXWIN];
+    int failed = 0;
+
+    for (unsigned int k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++)
+        for (unsigned int o = 0; o < sizeof(offsets) / sizeof(offsets[0]); o++)
+            for (p->invert = 0; p->invert < 2; p->invert++)
+                for (unsigned int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+                    int n = sizes[s];
+
+                    p->x = 0;
+                    kernels[k].kernel(p, n, borders, base);
+                    p->x = offsets[o];
+                    kernels[k].kernel(p, n, borders, rects);
+                    for (int i = 0; i < n; i++) {
+                        rect r = base[i];
+                        if (r.x != LAYOUT_UNPLACED)
+                            r.x += p->x;
+                        if (memcmp(&r, &rects[i], sizeof(rect))) {
+                            fprintf(stderr, "%s: window %d of %d is off at x %d\n",
+                                    kernels[k].name, i, n, p->x);
+                            failed++;
+                            break;
+                        }
+                    }
+                    printf("%s %d %d %d %08x\n", kernels[k].name, p->invert, p->x,
+                           n, checksum(rects, n));
+                }
+
+    p->x = 0;
+    p->invert = 0;
+    for (unsigned int h = 0; h < sizeof(hints) / sizeof(hints[0]); h++)
+        for (int center = 0; center < 2; center++)
+            for (int n = 1; n <= 10; n++) {
+                layout_stack(p, n, borders, rects);
+                for (int i = 0; i < n; i++)
+                    layout_hints(&hints[h], &rects[i], center);
+                printf("hints%u %d %d %d %08x\n", h, center, p->x, n, checksum(rects, n));
+            }
+    return failed;
+}
+
+int main(int argc, char *argv[])
+{
+    static int borders[MAXWIN];
+    static rect rects[MAXWIN];
+    layoutparams p = {
+        .ww = 1920, .wh = 1080, .h = 1080, .y = 0,
+        .gaps = 8, .growth = 0,
+        .mratio = 0.6, .msize = 0, .minwsz = 50,
+        .headborder = 2, .headtiled = 1, .monoborder = 0,
+    };
+    volatile int sink = 0;
+
+    for (int i = 0; i < MAXWIN; i++)
+        borders[i] = 2;
+
+    if (argc == 2 && !strcmp(argv[1], "-c"))
+        return check(&p, borders, rects) ? EXIT_FAILURE : EXIT_SUCCESS;
+
+    printf("%-10s %-6s %6s %12s %10s\n", "layout", "invert", "n", "ns/window", "checksum");
+    for (unsigned int k = 0; k < sizeof(kernels) / sizeof(kernels[0]); k++) {
+        for (p.invert = 0; p.invert < 2; p.invert++) {
+            for (unsigned int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+                int n = sizes[s], runs = MINWORK / n + 1;
+                double t;
+
+                kernels[k].kernel(&p, n, borders, rects);   /* warm up */
+                t = now();
+                for (int r = 0; r < runs; r++) {
+                    kernels[k].kernel(&p, n, borders, rects);
+                    sink += rects[n - 1].w;
+                }
+                t = now() - t;
+                printf("%-10s %-6s %6d %12.2f   %08x\n", kernels[k].name,
+                       p.invert ? "yes" : "no", n, t / runs / n, checksum(rects, n));
+            }
+        }
+    }
+    return EXIT_SUCCESS;
+}
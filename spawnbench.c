@@ -0,0 +1,132 @@
+/* see license for copyright and license */
+
+/*
+ * launch latency benchmark of spawn(), run with make bench
+ *
+ * a command is started the way spawn() does it, with posix_spawn(), and
+ * the old way with fork() and execvp(), while the process holds 0, 64 and
+ * 512 MiB of touched heap like a long running window manager might. a
+ * launch is timed from the call until the command was executed, which
+ * closes the close-on-exec end of a pipe the benchmark waits on.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <err.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#define LAUNCHES    200         /* timed launches per heap size and method */
+
+extern char **environ;
+
+static const int heaps[] = { 0, 64, 512 };     /* MiB */
+static const char *command[] = { "true", NULL };
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int cmp(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+static pid_t launch_fork(void)
+{
+    pid_t pid = fork();
+
+    if (pid)
+        return pid;
+    setsid();
+    execvp(command[0], (char **)command);
+    _exit(EXIT_FAILURE);
+}
+
+static pid_t launch_spawn(void)
+{
+    posix_spawnattr_t attr;
+    pid_t pid;
+
+    posix_spawnattr_init(&attr);
+#ifdef POSIX_SPAWN_SETSID
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETSID);
+#else
+    posix_spawnattr_setflags(&attr, POSIX_SPAWN_SETPGROUP);
+#endif
+    if (posix_spawnp(&pid, command[0], NULL, &attr, (char *const *)command, environ))
+        pid = -1;
+    posix_spawnattr_destroy(&attr);
+    return pid;
+}
+
+/* microseconds from the launch until the command was executed */
+static double launch(pid_t (*method)(void))
+{
+    int fds[2];
+    char c;
+    double start;
+    pid_t pid;
+
+    if (pipe(fds) < 0)
+        err(EXIT_FAILURE, "pipe");
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+    start = now();
+    if ((pid = method()) < 0)
+        err(EXIT_FAILURE, "cannot launch %s", command[0]);
+    close(fds[1]);
+    while (read(fds[0], &c, 1) > 0)
+        ;
+    start = (now() - start) / 1e3;
+    close(fds[0]);
+    waitpid(pid, NULL, 0);
+    return start;
+}
+
+int main(void)
+{
+    static const struct {
+        const char *name;
+        pid_t (*method)(void);
+    } methods[] = {
+        { "fork",  launch_fork },
+        { "spawn", launch_spawn },
+    };
+    static double t[LAUNCHES];
+
+    printf("%-6s %8s %10s %10s %10s %10s\n", "method", "heap MiB", "min us", "median us", "p95 us", "max us");
+    for (unsigned int h = 0; h < sizeof(heaps) / sizeof(heaps[0]); h++) {
+        size_t size = (size_t)heaps[h] << 20;
+        char *heap = NULL;
+
+        if (size) {
+            if ((heap = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)) == MAP_FAILED)
+                err(EXIT_FAILURE, "cannot map %d MiB", heaps[h]);
+            memset(heap, 1, size);      /* fork() has to copy what is mapped */
+        }
+        for (unsigned int m = 0; m < sizeof(methods) / sizeof(methods[0]); m++) {
+            launch(methods[m].method);  /* warm up */
+            for (int i = 0; i < LAUNCHES; i++)
+                t[i] = launch(methods[m].method);
+            qsort(t, LAUNCHES, sizeof(t[0]), cmp);
+            printf("%-6s %8d %10.1f %10.1f %10.1f %10.1f\n", methods[m].name, heaps[h],
+                   t[0], t[LAUNCHES / 2], t[LAUNCHES * 95 / 100], t[LAUNCHES - 1]);
+        }
+        if (heap)
+            munmap(heap, size);
+    }
+    return EXIT_SUCCESS;
+}
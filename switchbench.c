@@ -0,0 +1,145 @@
+/* see license for copyright and license */
+
+/*
+ * desktop switch latency benchmark, run with make xbench
+ *
+ * needs frankenwm running on $DISPLAY, make xbench starts both on Xvfb.
+ * desktops 0 and 1 are filled with 5, 50 and 500 windows each and switched
+ * back and forth. a switch is timed from sending _NET_CURRENT_DESKTOP to
+ * the root window until the property notify of _NET_CURRENT_DESKTOP.
+ * frankenwm writes it as the last request before it flushes and waits for
+ * the next event, after the layout, maps, moves, focus, _NET_WM_STATE and
+ * desktop info of the switch, so the notify comes once the X server has
+ * carried out all of them.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <err.h>
+#include <time.h>
+#include <xcb/xcb.h>
+
+#define SWITCHES    200         /* timed switches per window count */
+
+static const int sizes[] = { 5, 50, 500 };
+
+static xcb_connection_t *dis;
+static xcb_screen_t *screen;
+static xcb_atom_t net_current_desktop;
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static int cmp(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+static xcb_atom_t get_atom(const char *name)
+{
+    xcb_intern_atom_reply_t *r = xcb_intern_atom_reply(dis,
+                    xcb_intern_atom(dis, 0, strlen(name), name), NULL);
+    xcb_atom_t atom = r ? r->atom : XCB_ATOM_NONE;
+
+    free(r);
+    return atom;
+}
+
+/* wait for an event of the given type, a property notify must be for atom */
+static void wait_for(uint8_t type, xcb_atom_t atom)
+{
+    xcb_generic_event_t *e;
+
+    while ((e = xcb_wait_for_event(dis))) {
+        bool done = (e->response_type & ~0x80) == type;
+        if (done && type == XCB_PROPERTY_NOTIFY)
+            done = ((xcb_property_notify_event_t *)e)->atom == atom;
+        free(e);
+        if (done)
+            return;
+    }
+    errx(EXIT_FAILURE, "lost the connection to the X server");
+}
+
+/* ask the window manager to show desktop d and wait until it did */
+static void switch_desktop(uint32_t d)
+{
+    xcb_client_message_event_t ev;
+
+    memset(&ev, 0, sizeof(ev));
+    ev.response_type = XCB_CLIENT_MESSAGE;
+    ev.format = 32;
+    ev.window = screen->root;
+    ev.type = net_current_desktop;
+    ev.data.data32[0] = d;
+    xcb_send_event(dis, 0, screen->root, XCB_EVENT_MASK_SUBSTRUCTURE_REDIRECT
+                   | XCB_EVENT_MASK_SUBSTRUCTURE_NOTIFY, (char *)&ev);
+    xcb_flush(dis);
+    wait_for(XCB_PROPERTY_NOTIFY, net_current_desktop);
+}
+
+/* open n windows on the current desktop, return once all are managed */
+static void open_windows(xcb_window_t *w, int n)
+{
+    uint32_t values[] = { screen->white_pixel, XCB_EVENT_MASK_STRUCTURE_NOTIFY };
+
+    for (int i = 0; i < n; i++) {
+        w[i] = xcb_generate_id(dis);
+        xcb_create_window(dis, XCB_COPY_FROM_PARENT, w[i], screen->root,
+                          0, 0, 100, 100, 0, XCB_WINDOW_CLASS_INPUT_OUTPUT,
+                          screen->root_visual, XCB_CW_BACK_PIXEL | XCB_CW_EVENT_MASK, values);
+        xcb_map_window(dis, w[i]);
+    }
+    xcb_flush(dis);
+    for (int i = 0; i < n; i++)
+        wait_for(XCB_MAP_NOTIFY, XCB_ATOM_NONE);
+}
+
+int main(void)
+{
+    static xcb_window_t windows[2][500];
+    static double t[SWITCHES];
+    uint32_t mask = XCB_EVENT_MASK_PROPERTY_CHANGE;
+
+    dis = xcb_connect(NULL, NULL);
+    if (xcb_connection_has_error(dis))
+        errx(EXIT_FAILURE, "cannot connect to the X server");
+    screen = xcb_setup_roots_iterator(xcb_get_setup(dis)).data;
+    net_current_desktop = get_atom("_NET_CURRENT_DESKTOP");
+    xcb_change_window_attributes(dis, screen->root, XCB_CW_EVENT_MASK, &mask);
+
+    printf("%-8s %10s %10s %10s %10s\n", "windows", "min us", "median us", "p95 us", "max us");
+    for (unsigned int s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        int n = sizes[s];
+
+        switch_desktop(1);
+        open_windows(windows[1], n);
+        switch_desktop(0);
+        open_windows(windows[0], n);
+
+        for (int i = 0; i < SWITCHES; i++) {
+            double start = now();
+            switch_desktop(!(i & 1));
+            t[i] = (now() - start) / 1e3;
+        }
+        qsort(t, SWITCHES, sizeof(t[0]), cmp);
+        printf("%-8d %10.1f %10.1f %10.1f %10.1f\n", n,
+               t[0], t[SWITCHES / 2], t[SWITCHES * 95 / 100], t[SWITCHES - 1]);
+
+        for (int d = 0; d < 2; d++)
+            for (int i = 0; i < n; i++)
+                xcb_destroy_window(dis, windows[d][i]);
+        xcb_flush(dis);
+    }
+    xcb_disconnect(dis);
+    return EXIT_SUCCESS;
+}